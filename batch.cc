@@ -0,0 +1,213 @@
+/*
+ * Compiles and runs many programs in one process
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "decompress.h"
+#include "parser.h"
+
+using namespace std;
+
+batch_options::batch_options() {
+	jobs = 1;
+	lazy = false;
+	memo_capacity = 0;
+}
+
+typedef struct batch_result {
+	bool done;
+	bool readable;
+	string error;	// why a readable file could not be decompressed or run
+	int status;
+	string output;
+} batch_result;
+
+static bool is_directory(const string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// appends the *.txt files below dir, in no particular order
+static void find_programs(const string& dir, vector<string>& found) {
+	DIR* d = opendir(dir.c_str());
+	if (d == NULL)
+		return;
+
+	for (struct dirent* e = readdir(d); e != NULL; e = readdir(d)) {
+		string name = e->d_name;
+		if (name == "." || name == "..")
+			continue;
+
+		string path = dir + "/" + name;
+		if (is_directory(path))
+			find_programs(path, found);
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0)
+			found.push_back(path);
+	}
+
+	closedir(d);
+}
+
+// provided_tests/No_Error/t1.txt -> provided_tests_No_Error_t1.output, so
+// programs with the same name in different directories do not collide
+static string output_name(string path) {
+	if (path.compare(0, 2, "./") == 0)
+		path = path.substr(2);
+	if (path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0)
+		path.resize(path.size() - 4);
+	replace(path.begin(), path.end(), '/', '_');
+
+	return path + ".output";
+}
+
+// Compiles and runs the program in path exactly as a standalone run would,
+// but with its output collected in r and errors reported without exiting.
+// Anything else a program throws (std::out_of_range for a number too large
+// for an int, say) ends only that program, which is reported as failed
+static void run_program(const string& path, const batch_options& opts, batch_result& r) {
+	ifstream in(path.c_str());
+
+	r.readable = (bool) in;
+	r.status = 1;
+	if (!r.readable)
+		return;
+
+	string text;
+	if (!read_program(in, text, r.error)) {
+		r.readable = false;
+		return;
+	}
+	ostringstream os;
+	Parser parser(text);
+
+	parser.set_output(&os);
+	parser.set_lazy(opts.lazy);
+	if (opts.memo_capacity > 0)
+		parser.set_memo(opts.memo_capacity);
+
+	try {
+		parser.parse_input();
+		r.status = 0;
+	} catch (parse_exit& e) {
+		r.status = e.status;
+	} catch (exception& e) {
+		r.error = e.what();
+	}
+
+	r.output = os.str();
+}
+
+// Workers take programs in order from a shared counter; the calling thread
+// writes each result as soon as it and every program before it are done
+int run_batch(const vector<string>& paths, const batch_options& opts) {
+	vector<string> programs;
+
+	for (auto& path : paths) {
+		if (!is_directory(path)) {
+			programs.push_back(path);
+			continue;
+		}
+
+		vector<string> found;
+		find_programs(path, found);
+		sort(found.begin(), found.end());
+		programs.insert(programs.end(), found.begin(), found.end());
+	}
+
+	if (!opts.out_dir.empty() && !is_directory(opts.out_dir) && mkdir(opts.out_dir.c_str(), 0777) != 0) {
+		cerr << "cannot create " << opts.out_dir << "\n";
+		return 1;
+	}
+
+	int n = programs.size();
+	vector<batch_result> results(n);
+	mutex lock;
+	condition_variable finished;
+	int next = 0;
+
+	auto work = [&]() {
+		while (true) {
+			int i;
+			{
+				lock_guard<mutex> guard(lock);
+				if (next == n)
+					return;
+				i = next++;
+			}
+
+			batch_result r;
+			run_program(programs[i], opts, r);
+
+			lock_guard<mutex> guard(lock);
+			results[i] = move(r);
+			results[i].done = true;
+			finished.notify_all();
+		}
+	};
+
+	vector<thread> workers;
+	for (int w = 0; w < min(max(opts.jobs, 1), n); w++)
+		workers.push_back(thread(work));
+
+	int failed = 0;
+	int rejected = 0;
+
+	for (int i = 0; i < n; i++) {
+		batch_result r;
+		{
+			unique_lock<mutex> guard(lock);
+			finished.wait(guard, [&]() { return results[i].done; });
+			r = move(results[i]);
+		}
+
+		if (!r.readable) {
+			if (r.error.empty())
+				cerr << "cannot open " << programs[i] << "\n";
+			else
+				cerr << "cannot decompress " << programs[i] << ": " << r.error << "\n";
+			failed += 1;
+			continue;
+		}
+		if (!r.error.empty()) {
+			cerr << "cannot run " << programs[i] << ": " << r.error << "\n";
+			failed += 1;
+			continue;
+		}
+		rejected += (r.status != 0);
+
+		if (opts.out_dir.empty()) {
+			cout << "=== " << programs[i] << " status=" << r.status << " bytes=" << r.output.size() << "\n"
+				 << r.output << "\n";
+			continue;
+		}
+
+		string out_path = opts.out_dir + "/" + output_name(programs[i]);
+		ofstream out(out_path.c_str());
+		out << r.output;
+		if (!out) {
+			cerr << "cannot write " << out_path << "\n";
+			failed += 1;
+		}
+	}
+
+	for (auto& th : workers)
+		th.join();
+
+	cout.flush();
+	cerr << "batch: " << n << " programs, " << rejected << " rejected, "
+		 << failed << " failed\n";
+
+	return failed > 0;
+}
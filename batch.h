@@ -0,0 +1,29 @@
+/*
+ * Compiles and runs many programs in one process
+ */
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <string>
+#include <vector>
+
+typedef struct batch_options {
+	int jobs;				// programs compiled at the same time
+	std::string out_dir;	// where <name>.output files go, or "" for a framed stream
+	bool lazy;				// passed on to Parser::set_lazy()
+	long memo_capacity;		// passed on to Parser::set_memo() if > 0
+	batch_options();
+} batch_options;
+
+// Runs every program named in paths, where a directory stands for all *.txt
+// files below it in sorted order, on up to opts.jobs threads. Output is
+// written in the order of the programs: to one file per program in
+// opts.out_dir, or else to standard output, each program framed as
+//
+//     === <path> status=<exit status> bytes=<n>
+//     <n bytes of output>
+//
+// followed by a newline. Returns nonzero if a file could not be read or written.
+int run_batch(const std::vector<std::string>& paths, const batch_options& opts);
+
+#endif
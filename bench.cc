@@ -0,0 +1,113 @@
+/*
+ * In-process benchmark of the compiler phases
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "decompress.h"
+#include "parser.h"
+
+using namespace std;
+
+// discards everything written to it, but still pays for formatting
+class null_buffer : public streambuf {
+  protected:
+	int overflow(int c) { return c; }
+};
+
+typedef chrono::steady_clock bench_clock;
+
+static double elapsed_s(bench_clock::time_point start) {
+	return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void report(const char* phase, vector<double> samples, double units, const char* unit) {
+	sort(samples.begin(), samples.end());
+	double min_s = samples[0];
+	double median_s = samples[samples.size() / 2];
+
+	printf("phase=%s repeats=%d min_ms=%.3f median_ms=%.3f %s_per_s=%.0f\n",
+			phase, (int) samples.size(), min_s * 1e3, median_s * 1e3, unit,
+			median_s > 0 ? units / median_s : 0.0);
+}
+
+// Every repeat builds the program from scratch. Lexing is the Parser
+// construction, which scans all tokens up front; parsing includes the
+// normalization of each polynomial body; optimizing is composition inlining,
+// kernel selection and the search for runs of statements.
+// One untimed warm-up round runs first.
+int run_benchmark(istream& in, int repeats, int jobs) {
+	string text;
+	string error;
+	if (!read_program(in, text, error)) {
+		cerr << "cannot decompress the program: " << error << "\n";
+		return 1;
+	}
+	vector<double> lex_t, parse_t, check_t, opt_t, exec_t;
+	long tokens = 0;
+	long statements = 0;
+	long evaluations = 0;
+
+	null_buffer nb;
+	ostream null_out(&nb);
+
+	// a program with errors reports them once and ends the benchmark
+	try {
+		for (int i = 0; i <= repeats; i++) {
+			bench_clock::time_point start = bench_clock::now();
+			Parser parser(text, jobs);
+			double lex_s = elapsed_s(start);
+
+			start = bench_clock::now();
+			stmt* st_list = parser.parse_program();
+			parser.parse_inputs();
+			double parse_s = elapsed_s(start);
+
+			start = bench_clock::now();
+			parser.check_program();
+			double check_s = elapsed_s(start);
+
+			start = bench_clock::now();
+			parser.optimize_program(st_list);
+			double opt_s = elapsed_s(start);
+
+			parser.set_output(&null_out);
+			start = bench_clock::now();
+			parser.execute_program(st_list);
+			double exec_s = elapsed_s(start);
+
+			if (i == 0) {
+				tokens = parser.token_count();
+				for (stmt* pc = st_list->next; pc != NULL; pc = pc->next) {
+					statements += 1;
+					evaluations += (pc->stmt_type == POLY);
+				}
+				continue;
+			}
+
+			lex_t.push_back(lex_s);
+			parse_t.push_back(parse_s);
+			check_t.push_back(check_s);
+			opt_t.push_back(opt_s);
+			exec_t.push_back(exec_s);
+		}
+	} catch (parse_exit& e) {
+		return e.status;
+	}
+
+	printf("bytes=%ld tokens=%ld statements=%ld evaluations=%ld\n",
+			(long) text.size(), tokens, statements, evaluations);
+	report("lex", lex_t, tokens, "tokens");
+	report("parse", parse_t, tokens, "tokens");
+	report("check", check_t, tokens, "tokens");
+	report("optimize", opt_t, statements, "statements");
+	report("execute", exec_t, evaluations, "evaluations");
+
+	return 0;
+}
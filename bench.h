@@ -0,0 +1,14 @@
+/*
+ * In-process benchmark of the compiler phases
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <istream>
+
+// reads a program from in and runs every phase repeats times, printing
+// per-phase timings and throughput to standard output; jobs is passed
+// on to Parser::set_jobs()
+int run_benchmark(std::istream& in, int repeats, int jobs);
+
+#endif
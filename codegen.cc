@@ -0,0 +1,158 @@
+/*
+ * Ahead-of-time translation of a program to C++
+ */
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "parser.h"
+
+using namespace std;
+
+// powers up to this exponent are computed by a chain of multiplications,
+// higher ones by upow() in the generated code
+#define MAX_CHAINED_EXP 32
+// statements per generated function, to keep functions small enough for
+// the C++ compiler to optimize quickly
+#define STATEMENTS_PER_FUNCTION 1024
+
+// marks the polynomials reachable from pe in used
+static void mark_used(poly_eval* pe, vector<char>& used) {
+	used[pe->poly] = 1;
+	for (auto a : *pe->alist) {
+		if (a->etype == POLY)
+			mark_used(a->peval, used);
+	}
+}
+
+// the C++ expression for a call, e.g. p3(v[0], 5u, p1(v[2]))
+static string call_expr(poly_eval* pe) {
+	string s = "p" + to_string(pe->poly) + "(";
+
+	for (int i = 0; i < pe->alist->size(); i++) {
+		arg* a = (*pe->alist)[i];
+		if (i > 0)
+			s += ", ";
+		if (a->etype == POLY)
+			s += call_expr(a->peval);
+		else if (a->etype == ID)
+			s += "v[" + to_string(a->index) + "]";
+		else
+			s += to_string((unsigned int) a->value) + "u";
+	}
+
+	return s + ")";
+}
+
+// Writes one function computing the body of p with the wrap-around
+// arithmetic of evaluate_polynomial(). Every power of a parameter that the
+// body uses is computed once, then each term is a single product.
+static void emit_polynomial(int index, polynomial* p, ostream& os) {
+	int arity = p->param_names.size();
+	vector<int> max_exp(arity, 0);
+	vector<vector<int>> high_exps(arity);
+
+	for (auto curr_term : p->polynomial_body) {
+		for (auto curr_mon : curr_term->m_list) {
+			int v = curr_mon->var_name;
+			if (curr_mon->exp <= MAX_CHAINED_EXP)
+				max_exp[v] = max(max_exp[v], curr_mon->exp);
+			else if (find(high_exps[v].begin(), high_exps[v].end(), curr_mon->exp) == high_exps[v].end())
+				high_exps[v].push_back(curr_mon->exp);
+		}
+	}
+
+	os << "// " << p->name << ", declared on line " << p->decl_lineno << "\n"
+	   << "static unsigned int p" << index << "(";
+	for (int v = 0; v < arity; v++)
+		os << (v > 0 ? ", " : "") << "unsigned int a" << v;
+	os << ") {\n";
+
+	for (int v = 0; v < arity; v++) {
+		for (int e = 2; e <= max_exp[v]; e++) {
+			os << "\tunsigned int a" << v << "_" << e << " = a" << v
+			   << (e == 2 ? "" : "_" + to_string(e - 1)) << " * a" << v << ";\n";
+		}
+		for (auto e : high_exps[v])
+			os << "\tunsigned int a" << v << "_" << e << " = upow(a" << v << ", " << e << ");\n";
+	}
+
+	os << "\tunsigned int r = 0;\n";
+
+	char sign = '+';
+	for (auto curr_term : p->polynomial_body) {
+		unsigned int c = (unsigned int) curr_term->coefficient;
+		os << "\tr += " << (sign == '-' ? 0u - c : c) << "u";
+		for (auto curr_mon : curr_term->m_list) {
+			if (curr_mon->exp == 0)
+				continue;
+			os << " * a" << curr_mon->var_name;
+			if (curr_mon->exp > 1)
+				os << "_" << curr_mon->exp;
+		}
+		os << ";\n";
+		sign = curr_term->op;
+	}
+
+	os << "\treturn r;\n}\n\n";
+}
+
+// Writes a C++ program that prints what execute_program(start) would print.
+// The polynomials the statements call are compiled to functions; INPUT
+// statements read whitespace separated integers from standard input at run
+// time, with missing values read as 0 just as missing entries of the input
+// section are.
+void Parser::emit_cpp(stmt* start, ostream& os) {
+	vector<char> used(p_table.size(), 0);
+
+	for (stmt* pc = start->next; pc != NULL; pc = pc->next) {
+		if (pc->stmt_type == POLY)
+			mark_used(pc->pe, used);
+	}
+
+	os << "// generated by a.out --emit-cpp; build with e.g. g++ -O3\n"
+	   << "#include <cstdio>\n\n"
+	   << "static unsigned int v[" << max((size_t) 1, i_table.var_map.size()) << "];\n\n"
+	   << "static unsigned int upow(unsigned int b, int e) {\n"
+	   << "\tunsigned int r = 1;\n"
+	   << "\tfor (; e > 0; e >>= 1, b *= b)\n"
+	   << "\t\tif (e & 1)\n"
+	   << "\t\t\tr *= b;\n"
+	   << "\treturn r;\n"
+	   << "}\n\n"
+	   << "static unsigned int next_input() {\n"
+	   << "\tint x;\n"
+	   << "\treturn scanf(\"%d\", &x) == 1 ? (unsigned int) x : 0;\n"
+	   << "}\n\n";
+
+	for (int i = 0; i < p_table.size(); i++) {
+		if (used[i])
+			emit_polynomial(i, p_table[i], os);
+	}
+
+	int functions = 0;
+	int n = 0;
+
+	for (stmt* pc = start->next; pc != NULL; pc = pc->next, n++) {
+		if (n % STATEMENTS_PER_FUNCTION == 0) {
+			if (n > 0)
+				os << "}\n\n";
+			os << "static void run" << functions++ << "() {\n";
+		}
+
+		if (pc->stmt_type == POLY) {
+			os << "\tprintf(\"%d\\n\", (int) " << call_expr(pc->pe) << ");\n";
+		} else {
+			os << "\tv[" << pc->variable << "] = next_input();\t// "
+			   << i_table.var_map[pc->variable].first << "\n";
+		}
+	}
+	if (n > 0)
+		os << "}\n\n";
+
+	os << "int main() {\n";
+	for (int f = 0; f < functions; f++)
+		os << "\trun" << f << "();\n";
+	os << "\treturn 0;\n}\n";
+}
@@ -0,0 +1,375 @@
+/*
+ * Transparent decompression of gzip and zstd programs
+ */
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <dlfcn.h>
+
+#include "decompress.h"
+#include "memacct.h"
+
+using namespace std;
+
+// compressed bytes read from the source at once
+#define IN_BLOCK (1 << 18)
+// decoded bytes buffered for reads smaller than that
+#define OUT_BLOCK (1 << 16)
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+//////////////////////////////////////////////////////
+// Libraries
+//////////////////////////////////////////////////////
+
+// The parts of zlib.h and zstd.h used here. Both layouts are part of the
+// libraries' stable ABIs, and declaring them keeps the headers optional.
+
+typedef struct z_stream {
+	const unsigned char* next_in;
+	unsigned int avail_in;
+	unsigned long total_in;
+	unsigned char* next_out;
+	unsigned int avail_out;
+	unsigned long total_out;
+	const char* msg;
+	void* state;
+	void* zalloc;
+	void* zfree;
+	void* opaque;
+	int data_type;
+	unsigned long adler;
+	unsigned long reserved;
+} z_stream;
+
+#define Z_OK 0
+#define Z_STREAM_END 1
+#define Z_BUF_ERROR (-5)
+#define Z_NO_FLUSH 0
+// 15-bit window, with a gzip header
+#define GZIP_WINDOW_BITS (15 + 16)
+
+typedef struct zstd_in_buffer {
+	const void* src;
+	size_t size;
+	size_t pos;
+} zstd_in_buffer;
+
+typedef struct zstd_out_buffer {
+	void* dst;
+	size_t size;
+	size_t pos;
+} zstd_out_buffer;
+
+typedef struct decoder_library {
+	bool zlib;
+	int (*inflateInit2_)(z_stream*, int, const char*, int);
+	int (*inflate)(z_stream*, int);
+	int (*inflateReset)(z_stream*);
+	int (*inflateEnd)(z_stream*);
+
+	bool zstd;
+	void* (*ZSTD_createDStream)();
+	size_t (*ZSTD_initDStream)(void*);
+	size_t (*ZSTD_decompressStream)(void*, zstd_out_buffer*, zstd_in_buffer*);
+	unsigned (*ZSTD_isError)(size_t);
+	const char* (*ZSTD_getErrorName)(size_t);
+	size_t (*ZSTD_freeDStream)(void*);
+} decoder_library;
+
+template <typename F>
+static bool load(void* handle, const char* name, F& f) {
+	f = handle != NULL ? (F) dlsym(handle, name) : NULL;
+	return f != NULL;
+}
+
+// loaded once, on first use by any thread
+static const decoder_library& library() {
+	static decoder_library lib = []() {
+		decoder_library l;
+		void* z = dlopen("libz.so.1", RTLD_NOW | RTLD_LOCAL);
+		l.zlib = load(z, "inflateInit2_", l.inflateInit2_) && load(z, "inflate", l.inflate)
+			&& load(z, "inflateReset", l.inflateReset) && load(z, "inflateEnd", l.inflateEnd);
+
+		void* zs = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+		l.zstd = load(zs, "ZSTD_createDStream", l.ZSTD_createDStream)
+			&& load(zs, "ZSTD_initDStream", l.ZSTD_initDStream)
+			&& load(zs, "ZSTD_decompressStream", l.ZSTD_decompressStream)
+			&& load(zs, "ZSTD_isError", l.ZSTD_isError)
+			&& load(zs, "ZSTD_getErrorName", l.ZSTD_getErrorName)
+			&& load(zs, "ZSTD_freeDStream", l.ZSTD_freeDStream);
+		return l;
+	}();
+
+	return lib;
+}
+
+//////////////////////////////////////////////////////
+// DecodingBuffer
+//////////////////////////////////////////////////////
+
+DecodingBuffer::DecodingBuffer(streambuf* source) {
+	this->source = source;
+	format = UNKNOWN;
+	decoder = NULL;
+	open = false;
+	member_ended = false;
+	ended = false;
+	in_pos = 0;
+	in_size = 0;
+	setg(NULL, NULL, NULL);
+}
+
+DecodingBuffer::~DecodingBuffer() {
+	if (decoder == NULL)
+		return;
+	if (format == GZIP) {
+		library().inflateEnd((z_stream*) decoder);
+		delete (z_stream*) decoder;
+	} else {
+		library().ZSTD_freeDStream(decoder);
+	}
+}
+
+const string& DecodingBuffer::Error() {
+	return error;
+}
+
+void DecodingBuffer::Fail(const string& message) {
+	if (error.empty())
+		error = message;
+	ended = true;
+}
+
+// Looks at the first four bytes. They stay in the get area of plain data,
+// or become the first compressed input otherwise
+void DecodingBuffer::Detect() {
+	mem_scope scope(MEM_LEXER);
+	char magic[4];
+	size_t n = source->sgetn(magic, 4);
+
+	if (n >= 2 && memcmp(magic, gzip_magic, 2) == 0)
+		format = GZIP;
+	else if (n == 4 && memcmp(magic, zstd_magic, 4) == 0)
+		format = ZSTD;
+	else
+		format = PLAIN;
+
+	if (format == PLAIN) {
+		out.resize(OUT_BLOCK);
+		memcpy(out.data(), magic, n);
+		setg(out.data(), out.data(), out.data() + n);
+		return;
+	}
+
+	in.resize(IN_BLOCK);
+	memcpy(in.data(), magic, n);
+	in_size = n;
+	out.resize(OUT_BLOCK);
+
+	const decoder_library& lib = library();
+	if (format == GZIP) {
+		if (!lib.zlib) {
+			Fail("gzip data, but libz.so.1 cannot be loaded");
+			return;
+		}
+		z_stream* z = new z_stream();
+		if (lib.inflateInit2_(z, GZIP_WINDOW_BITS, "1.2.11", sizeof(z_stream)) != Z_OK) {
+			delete z;
+			Fail("cannot initialize zlib");
+			return;
+		}
+		decoder = z;
+	} else {
+		if (!lib.zstd) {
+			Fail("zstd data, but libzstd.so.1 cannot be loaded");
+			return;
+		}
+		decoder = lib.ZSTD_createDStream();
+		if (decoder == NULL || lib.ZSTD_isError(lib.ZSTD_initDStream(decoder))) {
+			Fail("cannot initialize libzstd");
+			return;
+		}
+	}
+}
+
+// reads the next block of compressed input once the last one is used up
+bool DecodingBuffer::FillInput() {
+	in_pos = 0;
+	in_size = source->sgetn(in.data(), in.size());
+	return in_size > 0;
+}
+
+// Tells whether another gzip member follows the one just decoded. Like
+// gzip -d, anything else after a member (the zero padding tar and some
+// transfer tools append, say) is not an error but the end of the data
+bool DecodingBuffer::NextMember() {
+	size_t left = in_size - in_pos;
+
+	if (left < 2) {
+		// keep a lone byte in front of the next block
+		memmove(in.data(), in.data() + in_pos, left);
+		in_pos = 0;
+		in_size = left + source->sgetn(in.data() + left, in.size() - left);
+	}
+
+	return in_size - in_pos >= 2 && memcmp(in.data() + in_pos, gzip_magic, 2) == 0;
+}
+
+// Decodes up to n bytes into dst. A gzip file may hold several members one
+// after the other, as cat a.gz b.gz produces; they are decoded in turn
+size_t DecodingBuffer::Inflate(char* dst, size_t n) {
+	const decoder_library& lib = library();
+	z_stream* z = (z_stream*) decoder;
+	size_t done = 0;
+
+	while (done < n && !ended) {
+		if (member_ended) {
+			if (!NextMember()) {
+				ended = true;
+				break;
+			}
+			member_ended = false;
+		}
+
+		z->next_in = (const unsigned char*) in.data() + in_pos;
+		z->avail_in = in_size - in_pos;
+		// avail_out is an unsigned int
+		size_t room = min(n - done, (size_t) 1 << 30);
+		z->next_out = (unsigned char*) dst + done;
+		z->avail_out = room;
+
+		int r = lib.inflate(z, Z_NO_FLUSH);
+		size_t used = (in_size - in_pos) - z->avail_in;
+		size_t made = room - z->avail_out;
+		in_pos += used;
+		done += made;
+		if (used > 0)
+			open = true;
+
+		if (r == Z_STREAM_END) {
+			lib.inflateReset(z);
+			open = false;
+			member_ended = true;
+		} else if (r != Z_OK && r != Z_BUF_ERROR) {
+			Fail(string("corrupt gzip data: ") + (z->msg != NULL ? z->msg : "inflate failed"));
+		} else if (used == 0 && made == 0 && in_pos == in_size && !FillInput()) {
+			if (open)
+				Fail("truncated gzip data");
+			ended = true;
+		}
+	}
+
+	return done;
+}
+
+// decodes up to n bytes into dst; frames that follow each other are decoded
+// in turn
+size_t DecodingBuffer::DecompressZstd(char* dst, size_t n) {
+	const decoder_library& lib = library();
+	size_t done = 0;
+
+	while (done < n && !ended) {
+		zstd_in_buffer zin = { in.data(), in_size, in_pos };
+		zstd_out_buffer zout = { dst, n, done };
+
+		size_t r = lib.ZSTD_decompressStream(decoder, &zout, &zin);
+		if (lib.ZSTD_isError(r)) {
+			Fail(string("corrupt zstd data: ") + lib.ZSTD_getErrorName(r));
+			break;
+		}
+
+		bool progress = zin.pos > in_pos || zout.pos > done;
+		in_pos = zin.pos;
+		done = zout.pos;
+		// 0 once a frame is decoded and flushed entirely; without input, r
+		// is the size of the next frame's header
+		if (progress)
+			open = (r != 0);
+
+		if (!progress && in_pos == in_size && !FillInput()) {
+			if (open)
+				Fail("truncated zstd data");
+			ended = true;
+		}
+	}
+
+	return done;
+}
+
+// puts up to n bytes of decoded data into dst; 0 at the end of the data
+size_t DecodingBuffer::Produce(char* dst, size_t n) {
+	if (format == UNKNOWN)
+		Detect();
+	if (ended)
+		return 0;
+	if (format == PLAIN)
+		return source->sgetn(dst, n);
+	if (format == GZIP)
+		return Inflate(dst, n);
+	return DecompressZstd(dst, n);
+}
+
+DecodingBuffer::int_type DecodingBuffer::underflow() {
+	if (gptr() == egptr()) {
+		if (format == UNKNOWN)
+			Detect();
+		if (gptr() == egptr()) {
+			size_t n = Produce(out.data(), out.size());
+			setg(out.data(), out.data(), out.data() + n);
+		}
+	}
+
+	return gptr() == egptr() ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+// Serves what the get area holds, then decodes whole blocks straight into s
+streamsize DecodingBuffer::xsgetn(char* s, streamsize n) {
+	streamsize done = 0;
+
+	while (done < n) {
+		streamsize buffered = egptr() - gptr();
+		if (buffered > 0) {
+			streamsize k = min(buffered, n - done);
+			memcpy(s + done, gptr(), k);
+			gbump(k);
+			done += k;
+		} else if (format != UNKNOWN && n - done >= OUT_BLOCK) {
+			size_t k = Produce(s + done, n - done);
+			if (k == 0)
+				break;
+			done += k;
+		} else if (underflow() == traits_type::eof()) {
+			break;
+		}
+	}
+
+	return done;
+}
+
+//////////////////////////////////////////////////////
+// DecodingStream
+//////////////////////////////////////////////////////
+
+DecodingStream::DecodingStream(istream& source) : istream(NULL), buffer(source.rdbuf()) {
+	rdbuf(&buffer);
+}
+
+const string& DecodingStream::Error() {
+	return buffer.Error();
+}
+
+DecodingStream& decoded_stdin() {
+	static DecodingStream stream(cin);
+	return stream;
+}
+
+bool read_program(istream& in, string& text, string& error) {
+	DecodingStream decoded(in);
+
+	text.assign(istreambuf_iterator<char>(decoded), istreambuf_iterator<char>());
+	error = decoded.Error();
+	return error.empty();
+}
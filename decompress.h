@@ -0,0 +1,71 @@
+/*
+ * Transparent decompression of gzip and zstd programs
+ */
+#ifndef __DECOMPRESS_H__
+#define __DECOMPRESS_H__
+
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Serves the bytes of source, inflated on the fly if they start with a gzip
+// (1f 8b) or zstd (28 b5 2f fd) magic number. zlib and libzstd are loaded
+// with dlopen() the first time compressed data is seen, so neither is
+// needed to build or to read plain programs. Large reads are decoded
+// straight into the reader's buffer; a failure ends the data early and
+// sets Error().
+class DecodingBuffer : public std::streambuf {
+  public:
+    explicit DecodingBuffer(std::streambuf* source);
+    ~DecodingBuffer();
+    const std::string& Error();
+
+  protected:
+    int_type underflow();
+    std::streamsize xsgetn(char* s, std::streamsize n);
+
+  private:
+    typedef enum { UNKNOWN, PLAIN, GZIP, ZSTD } Format;
+
+    std::streambuf* source;
+    Format format;
+    void* decoder;          // z_stream or ZSTD_DStream, once detected
+    bool open;              // inside a gzip member or zstd frame
+    bool member_ended;      // a gzip member was just decoded
+    bool ended;
+    std::string error;
+
+    std::vector<char> in;   // compressed bytes read from source
+    size_t in_pos;
+    size_t in_size;
+    std::vector<char> out;  // get area for reads smaller than a block
+
+    void Detect();
+    bool FillInput();
+    bool NextMember();
+    size_t Produce(char* dst, size_t n);
+    size_t Inflate(char* dst, size_t n);
+    size_t DecompressZstd(char* dst, size_t n);
+    void Fail(const std::string& message);
+};
+
+// an istream over a DecodingBuffer, e.g. DecodingStream program(cin);
+class DecodingStream : public std::istream {
+  public:
+    explicit DecodingStream(std::istream& source);
+    const std::string& Error();
+
+  private:
+    DecodingBuffer buffer;
+};
+
+// standard input, decoded; shared by everything that reads the program
+// from standard input
+DecodingStream& decoded_stdin();
+
+// reads all of in, decoded, into text; returns false and sets error if the
+// data could not be decompressed
+bool read_program(std::istream& in, std::string& text, std::string& error);
+
+#endif  //__DECOMPRESS_H__
@@ -8,39 +8,250 @@
 #include <vector>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "inputbuf.h"
+#include "memacct.h"
+#include "stats.h"
 
 using namespace std;
 
+#define BLOCK_SIZE (1 << 16)
+
+// reads standard input, BLOCK_SIZE bytes at a time, decompressing it if it
+// is gzip or zstd data
+InputBuffer::InputBuffer()
+{
+    in = &decoded_stdin();
+    data = NULL;
+    size = 0;
+    pos = 0;
+    eof = false;
+}
+
+// reads from text, which must outlive the buffer
+InputBuffer::InputBuffer(const string& text)
+{
+    in = NULL;
+    data = text.data();
+    size = text.size();
+    pos = 0;
+    eof = false;
+    STATS_ADD(bytes_read, size);
+}
+
+// reads the first length characters of text, which must outlive the buffer
+InputBuffer::InputBuffer(const char* text, size_t length)
+{
+    in = NULL;
+    data = text;
+    size = length;
+    pos = 0;
+    eof = false;
+}
+
+bool InputBuffer::Refill()
+{
+    if (in == NULL)
+        return false;
+
+    mem_scope scope(MEM_LEXER);
+    block.resize(BLOCK_SIZE);
+    in->read(&block[0], BLOCK_SIZE);
+    if (!in->Error().empty()) {
+        cerr << "cannot decompress the program: " << in->Error() << "\n";
+        exit(1);
+    }
+    data = &block[0];
+    size = in->gcount();
+    pos = 0;
+    STATS_ADD(bytes_read, size);
+    return size > 0;
+}
+
+// like cin.eof(), end of input is only reported after a read has
+// been attempted past the last character
 bool InputBuffer::EndOfInput()
 {
     if (!input_buffer.empty())
         return false;
     else
-        return cin.eof();
+        return eof;
 }
 
 char InputBuffer::UngetChar(char c)
 {
+    mem_scope scope(MEM_LEXER);
     if (c != EOF)
         input_buffer.push_back(c);;
     return c;
 }
 
+// on end of input c is left unchanged, as cin.get(c) does
 void InputBuffer::GetChar(char& c)
 {
     if (!input_buffer.empty()) {
         c = input_buffer.back();
         input_buffer.pop_back();
+    } else if (pos < size || Refill()) {
+        c = data[pos++];
     } else {
-        cin.get(c);
+        eof = true;
     }
 }
 
 string InputBuffer::UngetString(string s)
 {
+    mem_scope scope(MEM_LEXER);
     for (int i = 0; i < s.size(); i++)
         input_buffer.push_back(s[s.size()-i-1]);
     return s;
 }
+
+ValueReader::ValueReader(int fd)
+{
+    mem_scope scope(MEM_INPUTS);
+    this->fd = fd;
+    block.resize(BLOCK_SIZE);
+    pos = 0;
+    size = 0;
+    eof = false;
+    flush_os = NULL;
+    word = 0;
+}
+
+// os is flushed every time the reader is about to wait for more data, so
+// everything computed from earlier values is out before the next one arrives
+void ValueReader::FlushBeforeWait(ostream* os)
+{
+    flush_os = os;
+}
+
+bool ValueReader::Refill()
+{
+    if (eof)
+        return false;
+    carry.append(&block[word], size - word);
+    word = 0;
+    if (flush_os != NULL)
+        flush_os->flush();
+
+    ssize_t n;
+    do {
+        n = read(fd, &block[0], block.size());
+    } while (n < 0 && errno == EINTR);
+
+    pos = 0;
+    size = n > 0 ? n : 0;
+    eof = (n <= 0);
+    STATS_ADD(bytes_read, size);
+    return size > 0;
+}
+
+// longest part of a malformed word that is reported
+#define MAX_ERROR_WORD 32
+
+// Reads the next value, an optional '-' followed by digits; returns false
+// at the end of the stream or if the next word is not a number, which then
+// becomes Error()
+bool ValueReader::Next(int& value)
+{
+    bool negative = false;
+    bool digits = false;
+    unsigned int v = 0;
+
+    while ((pos < size || Refill()) && isspace(block[pos]))
+        pos++;
+
+    // Refill() moves what it replaces of the word to carry
+    word = pos;
+    carry.clear();
+
+    if ((pos < size || Refill()) && block[pos] == '-') {
+        negative = true;
+        pos++;
+    }
+
+    while ((pos < size || Refill()) && isdigit(block[pos])) {
+        v = v * 10 + (block[pos] - '0');
+        digits = true;
+        pos++;
+    }
+
+    if (digits && (pos == size || isspace(block[pos]))) {
+        value = (int) (negative ? 0u - v : v);
+        return true;
+    }
+
+    // the rest of the word, unless the stream simply ended
+    while ((pos < size || Refill()) && !isspace(block[pos]))
+        pos++;
+
+    error = carry;
+    error.append(&block[word], pos - word);
+    if (error.size() > MAX_ERROR_WORD) {
+        error.resize(MAX_ERROR_WORD);
+        error += "...";
+    }
+    return false;
+}
+
+const string& ValueReader::Error()
+{
+    return error;
+}
+
+InputFile::InputFile()
+{
+    data = NULL;
+    size = 0;
+}
+
+InputFile::~InputFile()
+{
+    if (data != NULL)
+        munmap(data, size);
+}
+
+// returns false if path cannot be opened or does not hold whole integers
+bool InputFile::Open(const string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size % sizeof(int) == 0;
+
+    // an empty file cannot be mapped, and holds no values anyway
+    if (ok && st.st_size > 0) {
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = (m != MAP_FAILED);
+        if (ok) {
+            data = m;
+            size = st.st_size;
+            madvise(data, size, MADV_SEQUENTIAL);
+        }
+    }
+
+    close(fd);
+    return ok;
+}
+
+// the values in file order; the host is assumed to be little-endian, as
+// every other binary format here is
+const int* InputFile::Values()
+{
+    return (const int*) data;
+}
+
+size_t InputFile::Count()
+{
+    return size / sizeof(int);
+}
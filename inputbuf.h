@@ -6,18 +6,75 @@
 #ifndef __INPUT_BUFFER__H__
 #define __INPUT_BUFFER__H__
 
+#include <istream>
+#include <ostream>
 #include <string>
 #include <vector>
 
+#include "decompress.h"
+
 class InputBuffer {
   public:
     void GetChar(char&);
     char UngetChar(char);
     std::string UngetString(std::string);
     bool EndOfInput();
+    InputBuffer();
+    InputBuffer(const std::string& text);
+    InputBuffer(const char* text, size_t length);
 
   private:
     std::vector<char> input_buffer;
+
+    // characters are served from [data, data + size); when reading from a
+    // stream, data points into block, which is refilled in large reads
+    DecodingStream* in;
+    std::vector<char> block;
+    const char* data;
+    size_t size;
+    size_t pos;
+    bool eof;
+
+    bool Refill();
+};
+
+// Reads whitespace separated integers from a file descriptor one block at a
+// time, so memory use does not depend on how many values the stream holds.
+// A word that is not a number ends the values too, and is kept in Error()
+class ValueReader {
+  public:
+    bool Next(int&);
+    void FlushBeforeWait(std::ostream*);
+    const std::string& Error();
+    ValueReader(int fd);
+
+  private:
+    int fd;
+    std::vector<char> block;
+    size_t pos;
+    size_t size;
+    bool eof;
+    std::ostream* flush_os;
+    size_t word;            // where the word being read starts in block
+    std::string carry;      // its start, from blocks already replaced
+    std::string error;      // the malformed word, or empty
+
+    bool Refill();
+};
+
+// Maps a file of 32-bit little-endian two's complement integers, whose
+// values are read in place; opening it costs the same whatever its size
+class InputFile {
+  public:
+    bool Open(const std::string& path);
+    const int* Values();
+    size_t Count();
+    InputFile();
+    ~InputFile();
+
+  private:
+    void* data;
+    size_t size;    // bytes mapped
 };
 
 #endif  //__INPUT_BUFFER__H__
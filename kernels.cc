@@ -0,0 +1,459 @@
+/*
+ * Vectorized evaluation of polynomials with many terms, specialized
+ * evaluation of polynomials with few parameters and low exponents, and
+ * evaluation schedules that share powers and products between terms
+ */
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+#include "kernels.h"
+#include "parser.h"
+
+using namespace std;
+
+// fewest terms for which a dense body pays for its power table
+#define MIN_FLAT_TERMS 64
+// largest number of parameters and power table entries a dense body may use
+#define MAX_FLAT_VARS 16
+#define MAX_FLAT_TABLE 65536
+// terms are padded to a multiple of this (one AVX-512 register of ints)
+#define FLAT_LANES 16
+
+flat_body* build_flat_body(const polynomial* p) {
+	int vars = p->param_names.size();
+	int terms = p->polynomial_body.size();
+	int max_exp = 0;
+
+	if (terms < MIN_FLAT_TERMS || vars > MAX_FLAT_VARS)
+		return NULL;
+
+	for (auto curr_term : p->polynomial_body) {
+		for (auto curr_mon : curr_term->m_list) {
+			if (curr_mon->var_name < 0)
+				return NULL;
+			if (curr_mon->exp > max_exp)
+				max_exp = curr_mon->exp;
+		}
+	}
+
+	// exponents of repeated variables add up in the dense form
+	flat_body* fb = new flat_body;
+	fb->vars = vars;
+	fb->terms = terms;
+	fb->padded = (terms + FLAT_LANES - 1) / FLAT_LANES * FLAT_LANES;
+	fb->monomials = 0;
+	fb->coefficients.assign(fb->padded, 0);
+
+	vector<vector<long>> exps(vars, vector<long>(fb->padded, 0));
+	char sign = '+';
+	int t = 0;
+
+	for (auto curr_term : p->polynomial_body) {
+		unsigned int c = (unsigned int) curr_term->coefficient;
+		fb->coefficients[t] = (int) (sign == '-' ? 0u - c : c);
+		for (auto curr_mon : curr_term->m_list) {
+			exps[curr_mon->var_name][t] += curr_mon->exp;
+			if (exps[curr_mon->var_name][t] > max_exp)
+				max_exp = exps[curr_mon->var_name][t];
+		}
+		fb->monomials += curr_term->m_list.size();
+		sign = curr_term->op;
+		t++;
+	}
+
+	if ((long) vars * (max_exp + 1) > MAX_FLAT_TABLE) {
+		delete fb;
+		return NULL;
+	}
+
+	fb->max_exp = max_exp;
+	fb->index.resize((long) vars * fb->padded);
+	for (int v = 0; v < vars; v++) {
+		for (t = 0; t < fb->padded; t++)
+			fb->index[v * fb->padded + t] = v * (max_exp + 1) + exps[v][t];
+	}
+
+	return fb;
+}
+
+// fills powers[v * (max_exp + 1) + e] with args[v]^e, using the same
+// wrap-around multiplication as int_pow()
+static void fill_powers(const flat_body* fb, const int* args, unsigned int* powers) {
+	for (int v = 0; v < fb->vars; v++) {
+		unsigned int* row = powers + v * (fb->max_exp + 1);
+		row[0] = 1;
+		for (int e = 1; e <= fb->max_exp; e++)
+			row[e] = row[e - 1] * (unsigned int) args[v];
+	}
+}
+
+static unsigned int flat_scalar(const flat_body* fb, const unsigned int* powers) {
+	unsigned int result = 0;
+
+	for (int t = 0; t < fb->terms; t++) {
+		unsigned int prod = (unsigned int) fb->coefficients[t];
+		for (int v = 0; v < fb->vars; v++)
+			prod *= powers[fb->index[v * fb->padded + t]];
+		result += prod;
+	}
+
+	return result;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static unsigned int flat_avx2(const flat_body* fb, const unsigned int* powers) {
+	const int* table = (const int*) powers;
+	__m256i acc = _mm256_setzero_si256();
+
+	for (int t = 0; t < fb->padded; t += 8) {
+		__m256i prod = _mm256_loadu_si256((const __m256i*) &fb->coefficients[t]);
+		for (int v = 0; v < fb->vars; v++) {
+			__m256i idx = _mm256_loadu_si256((const __m256i*) &fb->index[v * fb->padded + t]);
+			prod = _mm256_mullo_epi32(prod, _mm256_i32gather_epi32(table, idx, 4));
+		}
+		acc = _mm256_add_epi32(acc, prod);
+	}
+
+	unsigned int lanes[8];
+	_mm256_storeu_si256((__m256i*) lanes, acc);
+
+	unsigned int result = 0;
+	for (int i = 0; i < 8; i++)
+		result += lanes[i];
+	return result;
+}
+
+__attribute__((target("avx512f")))
+static unsigned int flat_avx512(const flat_body* fb, const unsigned int* powers) {
+	const int* table = (const int*) powers;
+	__m512i acc = _mm512_setzero_si512();
+
+	for (int t = 0; t < fb->padded; t += 16) {
+		__m512i prod = _mm512_loadu_si512((const void*) &fb->coefficients[t]);
+		for (int v = 0; v < fb->vars; v++) {
+			__m512i idx = _mm512_loadu_si512((const void*) &fb->index[v * fb->padded + t]);
+			prod = _mm512_mullo_epi32(prod, _mm512_i32gather_epi32(idx, table, 4));
+		}
+		acc = _mm512_add_epi32(acc, prod);
+	}
+
+	return (unsigned int) _mm512_reduce_add_epi32(acc);
+}
+
+#endif
+
+typedef unsigned int (*flat_kernel)(const flat_body*, const unsigned int*);
+
+// picks the widest kernel the CPU supports, once
+static flat_kernel select_flat_kernel(const char** name) {
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		*name = "avx512";
+		return flat_avx512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		*name = "avx2";
+		return flat_avx2;
+	}
+#endif
+	*name = "scalar";
+	return flat_scalar;
+}
+
+static const char* kernel_name;
+static const flat_kernel kernel = select_flat_kernel(&kernel_name);
+
+const char* flat_kernel_name() {
+	return kernel_name;
+}
+
+int evaluate_flat(const flat_body* fb, const int* args) {
+	static thread_local vector<unsigned int> powers;
+
+	powers.resize(fb->vars * (fb->max_exp + 1));
+	fill_powers(fb, args, powers.data());
+
+	return (int) kernel(fb, powers.data());
+}
+
+//////////////////////////////////////////////////////
+// Small bodies
+//////////////////////////////////////////////////////
+
+// Evaluates a small body with ARITY parameters and exponents of at most
+// MAX_EXP. Both bounds are constants, so the compiler unrolls the power
+// table and the inner product completely.
+template <int ARITY, int MAX_EXP>
+static unsigned int small_kernel_for(const small_body* sb, const int* args) {
+	unsigned int powers[ARITY][MAX_EXP + 1];
+
+	for (int v = 0; v < ARITY; v++) {
+		powers[v][0] = 1;
+		for (int e = 1; e <= MAX_EXP; e++)
+			powers[v][e] = powers[v][e - 1] * (unsigned int) args[v];
+	}
+
+	const unsigned int* coefficient = sb->coefficients.data();
+	const unsigned char* exp = sb->exps.data();
+	unsigned int result = 0;
+
+	for (int t = 0; t < sb->terms; t++, exp += ARITY) {
+		unsigned int prod = coefficient[t];
+		for (int v = 0; v < ARITY; v++)
+			prod *= powers[v][exp[v]];
+		result += prod;
+	}
+
+	return result;
+}
+
+// the kernels for every maximum exponent of one arity
+template <int ARITY, int... EXPS>
+struct small_kernel_row {
+	static constexpr small_kernel row[sizeof...(EXPS)] = { small_kernel_for<ARITY, EXPS>... };
+};
+
+template <int ARITY, int... EXPS>
+constexpr small_kernel small_kernel_row<ARITY, EXPS...>::row[sizeof...(EXPS)];
+
+#define SMALL_KERNEL_ROW(arity) small_kernel_row<arity, 0, 1, 2, 3, 4, 5, 6>::row
+
+// small_kernels[arity - 1][max_exp]
+static const small_kernel* const small_kernels[MAX_SMALL_ARITY] = {
+	SMALL_KERNEL_ROW(1), SMALL_KERNEL_ROW(2), SMALL_KERNEL_ROW(3), SMALL_KERNEL_ROW(4)
+};
+
+small_body* build_small_body(const polynomial* p) {
+	int arity = p->param_names.size();
+	int terms = p->polynomial_body.size();
+
+	if (arity < 1 || arity > MAX_SMALL_ARITY)
+		return NULL;
+
+	// exponents of repeated variables add up, as in a dense body
+	vector<int> exps((long) terms * arity, 0);
+	vector<unsigned int> coefficients(terms);
+	long monomials = 0;
+	int max_exp = 0;
+	char sign = '+';
+	int t = 0;
+
+	for (auto curr_term : p->polynomial_body) {
+		unsigned int c = (unsigned int) curr_term->coefficient;
+		coefficients[t] = (sign == '-') ? 0u - c : c;
+		for (auto curr_mon : curr_term->m_list) {
+			if (curr_mon->var_name < 0)
+				return NULL;
+			int& e = exps[(long) t * arity + curr_mon->var_name];
+			if (curr_mon->exp > MAX_SMALL_EXP - e)
+				return NULL;
+			e += curr_mon->exp;
+			if (e > max_exp)
+				max_exp = e;
+		}
+		monomials += curr_term->m_list.size();
+		sign = curr_term->op;
+		t++;
+	}
+
+	small_body* sb = new small_body;
+	sb->arity = arity;
+	sb->max_exp = max_exp;
+	sb->terms = terms;
+	sb->monomials = monomials;
+	sb->coefficients.swap(coefficients);
+	sb->exps.assign(exps.begin(), exps.end());
+	sb->kernel = small_kernels[arity - 1][max_exp];
+
+	return sb;
+}
+
+//////////////////////////////////////////////////////
+// Schedules
+//////////////////////////////////////////////////////
+
+// most terms whose shared products are searched for; every round of the
+// search looks at every pair of factors of every term
+#define MAX_SHARING_TERMS 256
+
+// builds the slots of a chain_body one multiplication at a time
+typedef struct chain_builder {
+	chain_body* cb;
+	vector<map<int, int>> powers;	// powers[v][e]: slot of parameter v raised to e
+
+	int multiply(int a, int b) {
+		chain_step s = { a, b };
+		cb->steps.push_back(s);
+		return cb->arity + (int) cb->steps.size();
+	}
+
+	// Slot of parameter v raised to e, computed from the powers of v there
+	// are already, as in an addition chain: the sum of two of them if
+	// there is one, else the square of e / 2 or e - 1 times v
+	int power(int v, int e) {
+		map<int, int>& have = powers[v];
+		auto it = have.find(e);
+		if (it != have.end())
+			return it->second;
+
+		int slot = -1;
+		for (auto& a : have) {
+			if (2 * a.first > e)
+				break;
+			auto b = have.find(e - a.first);
+			if (b != have.end()) {
+				slot = multiply(a.second, b->second);
+				break;
+			}
+		}
+
+		if (slot < 0 && e % 2 == 0) {
+			int half = power(v, e / 2);
+			slot = multiply(half, half);
+		} else if (slot < 0) {
+			slot = multiply(power(v, e - 1), have[1]);
+		}
+
+		have[e] = slot;
+		return slot;
+	}
+} chain_builder;
+
+// Powers come first: the exponents of each parameter are built in
+// increasing order, so every chain can reuse the powers below it (V^4 is
+// the square of V^2). Then, as long as some pair of factors occurs in two
+// or more terms, the most frequent pair becomes a slot of its own and
+// replaces the pair in those terms. What is left of each term is
+// multiplied out.
+chain_body* build_chain_body(const polynomial* p) {
+	int arity = p->param_names.size();
+	int terms = p->polynomial_body.size();
+
+	// exponents of repeated variables add up
+	vector<map<int, int>> exps(terms);
+	vector<unsigned int> coefficients(terms);
+	long monomials = 0;
+	char sign = '+';
+	int t = 0;
+
+	for (auto curr_term : p->polynomial_body) {
+		unsigned int c = (unsigned int) curr_term->coefficient;
+		coefficients[t] = (sign == '-') ? 0u - c : c;
+		for (auto curr_mon : curr_term->m_list) {
+			if (curr_mon->var_name < 0 || curr_mon->var_name >= arity)
+				return NULL;
+			if (curr_mon->exp > 0)
+				exps[t][curr_mon->var_name] += curr_mon->exp;
+		}
+		monomials += curr_term->m_list.size();
+		sign = curr_term->op;
+		t++;
+	}
+
+	chain_body* cb = new chain_body;
+	cb->arity = arity;
+	cb->monomials = monomials;
+
+	chain_builder b;
+	b.cb = cb;
+	b.powers.resize(arity);
+	for (int v = 0; v < arity; v++)
+		b.powers[v][1] = v;
+
+	vector<set<int>> needed(arity);
+	for (auto& term_exps : exps) {
+		for (auto& it : term_exps)
+			needed[it.first].insert(it.second);
+	}
+	for (int v = 0; v < arity; v++) {
+		for (int e : needed[v])
+			b.power(v, e);
+	}
+
+	// the factors of every term, as slots; one power per parameter, so
+	// they are distinct
+	vector<vector<int>> factors(terms);
+	for (t = 0; t < terms; t++) {
+		for (auto& it : exps[t])
+			factors[t].push_back(b.powers[it.first][it.second]);
+		sort(factors[t].begin(), factors[t].end());
+	}
+
+	while (terms <= MAX_SHARING_TERMS && cb->steps.size() < MAX_CHAIN_SLOTS) {
+		map<pair<int, int>, int> pairs;
+		for (auto& f : factors) {
+			for (int i = 0; i < f.size(); i++) {
+				for (int j = i + 1; j < f.size(); j++)
+					pairs[make_pair(f[i], f[j])] += 1;
+			}
+		}
+
+		pair<int, int> best;
+		int count = 1;
+		for (auto& it : pairs) {
+			if (it.second > count) {
+				best = it.first;
+				count = it.second;
+			}
+		}
+		if (count < 2)
+			break;
+
+		int shared = b.multiply(best.first, best.second);
+		for (auto& f : factors) {
+			auto i = find(f.begin(), f.end(), best.first);
+			auto j = find(f.begin(), f.end(), best.second);
+			if (i == f.end() || j == f.end())
+				continue;
+			f.erase(j);
+			f.erase(find(f.begin(), f.end(), best.first));
+			f.insert(lower_bound(f.begin(), f.end(), shared), shared);
+		}
+	}
+
+	for (t = 0; t < terms; t++) {
+		int slot = arity;	// the constant 1
+		if (!factors[t].empty()) {
+			slot = factors[t][0];
+			for (int i = 1; i < factors[t].size(); i++)
+				slot = b.multiply(slot, factors[t][i]);
+		}
+		cb->term_slots.push_back(slot);
+	}
+
+	if (arity + 1 + cb->steps.size() > MAX_CHAIN_SLOTS) {
+		delete cb;
+		return NULL;
+	}
+
+	cb->coefficients.swap(coefficients);
+	return cb;
+}
+
+int evaluate_chain(const chain_body* cb, const int* args) {
+	unsigned int slot[MAX_CHAIN_SLOTS];
+	int n = cb->arity;
+
+	for (int v = 0; v < n; v++)
+		slot[v] = (unsigned int) args[v];
+	slot[n++] = 1;
+	for (auto& s : cb->steps)
+		slot[n++] = slot[s.a] * slot[s.b];
+
+	unsigned int result = 0;
+	for (int t = 0; t < cb->term_slots.size(); t++)
+		result += cb->coefficients[t] * slot[cb->term_slots[t]];
+
+	return (int) result;
+}
@@ -0,0 +1,101 @@
+/*
+ * Vectorized evaluation of polynomials with many terms, specialized
+ * evaluation of polynomials with few parameters and low exponents, and
+ * evaluation schedules that share powers and products between terms
+ */
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include <vector>
+
+struct polynomial;
+
+// Dense form of a large polynomial body. Term t evaluates to
+//
+//     coefficients[t] * product over v of powers[index[v * padded + t]]
+//
+// where powers[v * (max_exp + 1) + e] is argument v raised to e, so every term
+// is a fixed number of table lookups and multiplications with no branches.
+// Terms are padded with zero terms to a multiple of the widest vector.
+typedef struct flat_body {
+	int vars;
+	int max_exp;
+	int terms;
+	int padded;
+	long monomials;		// monomial factors in the original body, for --stats
+	std::vector<int> coefficients;
+	std::vector<int> index;
+} flat_body;
+
+// returns the dense form of p, or NULL if p is too small to benefit or
+// its power table would be too large
+flat_body* build_flat_body(const polynomial* p);
+
+// evaluates a dense body at args (one value per parameter) with the widest
+// kernel the CPU supports
+int evaluate_flat(const flat_body* fb, const int* args);
+
+// "avx512", "avx2" or "scalar"
+const char* flat_kernel_name();
+
+// largest number of parameters and exponent a small body may have
+#define MAX_SMALL_ARITY 4
+#define MAX_SMALL_EXP 6
+
+struct small_body;
+typedef unsigned int (*small_kernel)(const small_body*, const int*);
+
+// Compact form of a polynomial with at most MAX_SMALL_ARITY parameters, none
+// raised to more than MAX_SMALL_EXP. Term t evaluates to
+//
+//     coefficients[t] * product over v of args[v]^exps[t * arity + v]
+//
+// and kernel is instantiated for exactly this arity and maximum exponent,
+// so the powers of the arguments are computed by straight-line code.
+typedef struct small_body {
+	int arity;
+	int max_exp;
+	int terms;
+	long monomials;		// monomial factors in the original body, for --stats
+	std::vector<unsigned int> coefficients;
+	std::vector<unsigned char> exps;
+	small_kernel kernel;
+} small_body;
+
+// returns the compact form of p, or NULL if p has too many parameters or
+// too high an exponent
+small_body* build_small_body(const polynomial* p);
+
+inline int evaluate_small(const small_body* sb, const int* args) {
+	return (int) sb->kernel(sb, args);
+}
+
+// most values a schedule may compute
+#define MAX_CHAIN_SLOTS 4096
+
+// slot[dst] = slot[a] * slot[b]
+typedef struct chain_step {
+	int a;
+	int b;
+} chain_step;
+
+// Evaluation schedule of any other polynomial. Slots 0 .. arity - 1 hold
+// the arguments and slot arity holds 1; step i computes slot arity + 1 + i
+// from earlier slots. Every power of a parameter and every product shared
+// by several terms is a slot of its own, so it is computed once per call,
+// and term t evaluates to coefficients[t] * slot[term_slots[t]].
+typedef struct chain_body {
+	int arity;
+	long monomials;		// monomial factors in the original body, for --stats
+	std::vector<chain_step> steps;
+	std::vector<unsigned int> coefficients;
+	std::vector<int> term_slots;
+} chain_body;
+
+// returns the schedule of p, or NULL if it would need more than
+// MAX_CHAIN_SLOTS slots
+chain_body* build_chain_body(const polynomial* p);
+
+int evaluate_chain(const chain_body* cb, const int* args);
+
+#endif
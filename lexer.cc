@@ -8,9 +8,15 @@
 #include <vector>
 #include <string>
 #include <cctype>
+#include <climits>
+#include <algorithm>
+#include <thread>
 
 #include "lexer.h"
 #include "inputbuf.h"
+#include "memacct.h"
+#include "stats.h"
+#include "tokenqueue.h"
 
 using namespace std;
 
@@ -33,6 +39,191 @@ void Token::Print()
 // internal vector. This faciliates the implementation of peek() and UngetToken()
 LexicalAnalyzer::LexicalAnalyzer()
 {
+    queue = NULL;
+    scanner = NULL;
+    phase_timer timer(PHASE_LEX);
+    ScanAll();
+    STATS_ADD(tokens, count);
+}
+
+// Same as above, but the program is read from text instead of standard input.
+// text must stay alive while the lexer is being constructed
+LexicalAnalyzer::LexicalAnalyzer(const string& text) : input(text)
+{
+    queue = NULL;
+    scanner = NULL;
+    phase_timer timer(PHASE_LEX);
+    ScanAll();
+    STATS_ADD(tokens, count);
+}
+
+// smallest input worth splitting between threads
+#define MIN_PARALLEL_BYTES (1 << 20)
+
+// Same as above, but large inputs are scanned on up to jobs threads. The
+// tokens are identical to those of a sequential scan
+LexicalAnalyzer::LexicalAnalyzer(const string& text, int jobs) : input(text)
+{
+    queue = NULL;
+    scanner = NULL;
+    phase_timer timer(PHASE_LEX);
+    if (jobs > 1 && text.size() >= MIN_PARALLEL_BYTES)
+        ScanParallel(text, jobs);
+    else
+        ScanAll();
+    STATS_ADD(tokens, count);
+}
+
+// scans the first length characters of text on its own, for ScanParallel()
+LexicalAnalyzer::LexicalAnalyzer(const char* text, size_t length) : input(text, length)
+{
+    queue = NULL;
+    scanner = NULL;
+    ScanAll();
+}
+
+// No token spans whitespace and the scanner never looks past the character
+// that ends a token, so splitting text just before a whitespace character
+// cannot change how either side is scanned. Every chunk is scanned into its
+// own token list, with line numbers counted from 1; they are then shifted by
+// the number of newlines in all earlier chunks and concatenated.
+void LexicalAnalyzer::ScanParallel(const string& text, int jobs)
+{
+    mem_scope scope(MEM_TOKENS);
+    vector<size_t> bounds;
+    bounds.push_back(0);
+    for (int i = 1; i < jobs; i++) {
+        size_t pos = max(bounds.back(), text.size() / jobs * i);
+        while (pos < text.size() && !isspace(text[pos]))
+            pos++;
+        if (pos > bounds.back() && pos < text.size())
+            bounds.push_back(pos);
+    }
+    bounds.push_back(text.size());
+
+    int n = bounds.size() - 1;
+    vector<LexicalAnalyzer*> chunks(n);
+    vector<int> newlines(n);
+    vector<thread> threads;
+
+    for (int i = 0; i < n; i++) {
+        threads.push_back(thread([&, i]() {
+            const char* begin = text.data() + bounds[i];
+            const char* end = text.data() + bounds[i + 1];
+            chunks[i] = new LexicalAnalyzer(begin, end - begin);
+            newlines[i] = std::count(begin, end, '\n');
+        }));
+    }
+    for (auto& th : threads)
+        th.join();
+
+    size_t total = 0;
+    for (int i = 0; i < n; i++)
+        total += chunks[i]->tokenList.size();
+    tokenList.reserve(total);
+
+    int line_offset = 0;
+    for (int i = 0; i < n; i++) {
+        for (auto& token : chunks[i]->tokenList) {
+            tokenList.push_back(std::move(token));
+            tokenList.back().line_no += line_offset;
+        }
+        line_offset += newlines[i];
+        delete chunks[i];
+    }
+
+    line_no = line_offset + 1;
+    index = 0;
+    tokens = tokenList.data();
+    count = tokenList.size();
+}
+
+// Creates a lexer that serves tokens [begin, end) of source without copying
+// them; source must outlive it. This lets several parsers work on different
+// parts of one program at the same time
+LexicalAnalyzer::LexicalAnalyzer(const LexicalAnalyzer& source, int begin, int end)
+{
+    queue = NULL;
+    scanner = NULL;
+    tokens = source.tokens + begin;
+    count = end - begin;
+    index = 0;
+    line_no = (end > begin) ? tokens[count - 1].line_no : source.line_no;
+}
+
+// Scans standard input on a thread of its own while the parser works
+// through the tokens scanned so far. At most queue_tokens tokens are in
+// flight between the two; the tokens the parser has reached are kept, so
+// the lexer behaves exactly like one that scanned everything up front
+LexicalAnalyzer::LexicalAnalyzer(int queue_tokens)
+{
+    tokens = NULL;
+    count = 0;
+    index = 0;
+    mem_scope scope(MEM_TOKENS);
+    queue = new TokenQueue(queue_tokens);
+    scanner = new thread(&LexicalAnalyzer::ScanPipelined, this);
+}
+
+LexicalAnalyzer::~LexicalAnalyzer()
+{
+    if (scanner != NULL) {
+        queue->Cancel();
+        scanner->join();
+        delete scanner;
+    }
+    delete queue;
+}
+
+// runs on the scanner thread, and ends with an END_OF_FILE token
+void LexicalAnalyzer::ScanPipelined()
+{
+    phase_timer timer(PHASE_LEX);
+    mem_scope scope(MEM_TOKENS);
+    long n = 0;
+
+    this->line_no = 1;
+    tmp.lexeme = "";
+    tmp.line_no = 1;
+    tmp.token_type = ERROR;
+
+    while (true) {
+        Token token = GetTokenMain();
+        bool last = (token.token_type == END_OF_FILE);
+
+        if (!queue->Push(token) || last)
+            break;
+        n++;
+    }
+
+    STATS_ADD(tokens, n);
+}
+
+// waits until token i has been handed over or the scanner is done
+void LexicalAnalyzer::Fill(int i)
+{
+    while (scanner != NULL && count <= i) {
+        mem_scope scope(MEM_TOKENS);
+        Token token;
+        queue->Pop(token);
+
+        if (token.token_type == END_OF_FILE) {
+            // line_no was last written by the scanner thread
+            scanner->join();
+            delete scanner;
+            scanner = NULL;
+            break;
+        }
+
+        tokenList.push_back(std::move(token));
+        tokens = tokenList.data();
+        count = tokenList.size();
+    }
+}
+
+void LexicalAnalyzer::ScanAll()
+{
+    mem_scope scope(MEM_TOKENS);
     this->line_no = 1;
     tmp.lexeme = "";
     tmp.line_no = 1;
@@ -48,6 +239,8 @@ LexicalAnalyzer::LexicalAnalyzer()
     }
     // pushes END_OF_FILE is not pushed on the token list
 
+    tokens = tokenList.data();
+    count = tokenList.size();
 }
 
 bool LexicalAnalyzer::SkipSpace()
@@ -157,18 +350,54 @@ Token LexicalAnalyzer::ScanIdOrKeyword()
 Token LexicalAnalyzer::GetToken()
 {
     Token token;
-    if (index == tokenList.size()){       // return end of file if
+    Fill(index);
+    if (index == count){                  // return end of file if
         token.lexeme = "";                // index is too large
         token.line_no = line_no;
         token.token_type = END_OF_FILE;
     }
     else{
-        token = tokenList[index];
+        token = tokens[index];
         index = index + 1;
     }
     return token;
 }
 
+// number of tokens in the program, not counting END_OF_FILE
+int LexicalAnalyzer::TokenCount()
+{
+    Fill(INT_MAX);
+    return count;
+}
+
+// whether the program has an i-th token; unlike i < TokenCount(), this
+// does not wait for the rest of a pipelined scan
+bool LexicalAnalyzer::HasToken(int i)
+{
+    Fill(i);
+    return i < count;
+}
+
+// the i-th token of the program, for an i that HasToken(i); the reference
+// is valid until the lexer hands over more tokens
+const Token& LexicalAnalyzer::TokenAt(int i)
+{
+    Fill(i);
+    return tokens[i];
+}
+
+// index of the token the next GetToken() returns
+int LexicalAnalyzer::GetIndex()
+{
+    return index;
+}
+
+// repositions the lexer so that the next GetToken() returns token i
+void LexicalAnalyzer::SetIndex(int i)
+{
+    index = i;
+}
+
 // UngetToken() resets the index back by a amount equal to its argument 
 // "howMany". "howMany" should be positive and not larger than the 
 // actual number of valid tokens that were obtained using GetToken()
@@ -206,14 +435,15 @@ Token LexicalAnalyzer::peek(int howFar)
     } 
 
     int peekIndex = index + howFar - 1;
-    if (peekIndex > (tokenList.size()-1)) { // if peeking too far
+    Fill(peekIndex);
+    if (peekIndex > count - 1) {            // if peeking too far
         Token token;                        // return END_OF_FILE
         token.lexeme = "";
         token.line_no = line_no;
         token.token_type = END_OF_FILE;
         return token;
     } else
-        return tokenList[peekIndex];
+        return tokens[peekIndex];
 }
 
 Token LexicalAnalyzer::GetTokenMain()
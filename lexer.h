@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <string>
+#include <thread>
 
 #include "inputbuf.h"
 
@@ -28,21 +29,47 @@ class Token {
     int line_no;
 };
 
+class TokenQueue;
+
 class LexicalAnalyzer {
   public:
     Token GetToken();
     void UngetToken(int);
     Token peek(int);
+    int TokenCount();
+    bool HasToken(int);
+    const Token& TokenAt(int);
+    int GetIndex();
+    void SetIndex(int);
     LexicalAnalyzer();
+    LexicalAnalyzer(const std::string& text);
+    LexicalAnalyzer(const std::string& text, int jobs);
+    LexicalAnalyzer(const LexicalAnalyzer& source, int begin, int end);
+    explicit LexicalAnalyzer(int queue_tokens);
+    ~LexicalAnalyzer();
 
   private:
     std::vector<Token> tokenList;
+    // tokens served by GetToken() and peek(): tokenList, or a range of
+    // another lexer's tokenList for lexers created from a range
+    const Token* tokens;
+    int count;
+    LexicalAnalyzer(const char* text, size_t length);
+    void ScanAll();
+    void ScanParallel(const std::string& text, int jobs);
+    void ScanPipelined();
+    void Fill(int);
     Token GetTokenMain();
     int line_no;
     int index;
     Token tmp;
     InputBuffer input;
 
+    // set while a scanner thread is still handing tokens over through
+    // queue; they are appended to tokenList as the parser reaches them
+    TokenQueue* queue;
+    std::thread* scanner;
+
     bool SkipSpace();
     bool IsKeyword(std::string);
     TokenType FindKeywordIndex(std::string);
@@ -0,0 +1,318 @@
+/*
+ * Command line driver
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.h"
+#include "bench.h"
+#include "decompress.h"
+#include "memacct.h"
+#include "parser.h"
+#include "perfcount.h"
+#include "profiler.h"
+#include "stats.h"
+
+using namespace std;
+
+// registered with atexit() so the report is printed even when the program
+// stops at an error
+static void report_stats() {
+	stats.report();
+}
+
+static void usage() {
+	cerr << "usage: a.out [options] < program.txt\n"
+		 << "       a.out --batch[-out=DIR] [options] FILE|DIR...\n"
+		 << "  --bench[=N]    time each compiler phase over N repeats (default 5)\n"
+		 << "  --jobs=N       lex large programs and parse large declaration\n"
+		 << "                 sections on N threads\n"
+		 << "                 (0: one per core)\n"
+		 << "  --stats[=json] report phase timings and counters on stderr\n"
+		 << "  --memory[=json]\n"
+		 << "                 report live and peak allocated bytes per subsystem on\n"
+		 << "                 stderr at the end of every compiler phase\n"
+		 << "  --perf         add cycles, instructions, branch misses and L1/LLC misses\n"
+		 << "                 per phase to --stats (implied), and per polynomial and\n"
+		 << "                 call site to --profile\n"
+		 << "  --profile=FILE write per-call-site evaluation times to FILE as\n"
+		 << "                 collapsed stacks and a per-polynomial summary to stderr\n"
+		 << "  --program=FILE read the program from FILE instead of standard input\n"
+		 << "  --stream-inputs[=FD]\n"
+		 << "                 read INPUT values from descriptor FD (default 0, needs\n"
+		 << "                 --program) as INPUT statements need them, after the\n"
+		 << "                 program's input section, which becomes optional\n"
+		 << "  --inputs=FILE  read INPUT values from FILE, 32-bit little-endian integers,\n"
+		 << "                 after the program's input section, which becomes optional\n"
+		 << "  --memo=N       cache the results of up to N distinct calls\n"
+		 << "  --lazy         build polynomial bodies only when a statement uses them\n"
+		 << "  --pipeline[=N] scan standard input on a second thread while it is parsed,\n"
+		 << "                 with up to N tokens (default 4096) in between\n"
+		 << "  --binary=FILE  write results to FILE (- for standard output) as 32-bit\n"
+		 << "                 little-endian integers instead of text\n"
+		 << "  --binary-header\n"
+		 << "                 start the binary results with their count and the line\n"
+		 << "                 numbers of the evaluation statements\n"
+		 << "  --emit-cpp=FILE\n"
+		 << "                 instead of running the program, write it to FILE as a\n"
+		 << "                 C++ program that reads the inputs from standard input\n"
+		 << "  --gradient     print each result followed by its partial derivatives with\n"
+		 << "                 respect to the called polynomial's parameters\n"
+		 << "  --batch        compile and run every program FILE, or every *.txt file\n"
+		 << "                 below DIR, on --jobs threads and print the outputs\n"
+		 << "                 framed by \"=== FILE status=S bytes=N\" lines\n"
+		 << "  --batch-out=DIR\n"
+		 << "                 write each output to DIR/<FILE with / as _>.output\n";
+	exit(1);
+}
+
+int main(int argc, char* argv[]) {
+	int bench_repeats = 0;
+	int jobs = 1;
+	string program_path;
+	int stream_fd = -1;
+	string inputs_path;
+	long memo_capacity = 0;
+	bool lazy = false;
+	int pipeline_tokens = 0;
+	string binary_path;
+	bool binary_header = false;
+	string cpp_path;
+	bool gradient = false;
+	bool batch = false;
+	string batch_out;
+	vector<string> paths;
+	string profile_path;
+
+	for (int i = 1; i < argc; i++) {
+		string opt = argv[i];
+
+		if (opt == "--bench") {
+			bench_repeats = 5;
+		} else if (opt.compare(0, 8, "--bench=") == 0) {
+			bench_repeats = atoi(opt.c_str() + 8);
+			if (bench_repeats <= 0)
+				usage();
+		} else if (opt.compare(0, 10, "--profile=") == 0 && opt.size() > 10) {
+			profile_path = opt.substr(10);
+			profiler.enabled = true;
+		} else if (opt.compare(0, 7, "--jobs=") == 0) {
+			jobs = atoi(opt.c_str() + 7);
+			if (jobs == 0)
+				jobs = thread::hardware_concurrency();
+			if (jobs <= 0)
+				jobs = 1;
+		} else if (opt.compare(0, 10, "--program=") == 0 && opt.size() > 10) {
+			program_path = opt.substr(10);
+		} else if (opt == "--stream-inputs") {
+			stream_fd = 0;
+		} else if (opt.compare(0, 16, "--stream-inputs=") == 0 && opt.size() > 16) {
+			stream_fd = atoi(opt.c_str() + 16);
+		} else if (opt.compare(0, 9, "--inputs=") == 0 && opt.size() > 9) {
+			inputs_path = opt.substr(9);
+		} else if (opt.compare(0, 7, "--memo=") == 0) {
+			memo_capacity = atol(opt.c_str() + 7);
+			if (memo_capacity <= 0)
+				usage();
+		} else if (opt == "--lazy") {
+			lazy = true;
+		} else if (opt == "--pipeline") {
+			pipeline_tokens = 4096;
+		} else if (opt.compare(0, 11, "--pipeline=") == 0) {
+			pipeline_tokens = atoi(opt.c_str() + 11);
+			if (pipeline_tokens <= 0)
+				usage();
+		} else if (opt.compare(0, 9, "--binary=") == 0 && opt.size() > 9) {
+			binary_path = opt.substr(9);
+		} else if (opt == "--binary-header") {
+			binary_header = true;
+		} else if (opt.compare(0, 11, "--emit-cpp=") == 0 && opt.size() > 11) {
+			cpp_path = opt.substr(11);
+		} else if (opt == "--gradient") {
+			gradient = true;
+		} else if (opt == "--batch") {
+			batch = true;
+		} else if (opt.compare(0, 12, "--batch-out=") == 0 && opt.size() > 12) {
+			batch = true;
+			batch_out = opt.substr(12);
+		} else if (opt.size() > 0 && opt[0] != '-') {
+			paths.push_back(opt);
+		} else if (opt == "--stats") {
+			stats.enabled = true;
+		} else if (opt == "--stats=json") {
+			stats.enabled = true;
+			stats.json = true;
+		} else if (opt == "--perf") {
+			perf.enabled = true;
+			stats.enabled = true;
+		} else if (opt == "--memory") {
+			memacct.enabled = true;
+		} else if (opt == "--memory=json") {
+			memacct.enabled = true;
+			memacct.json = true;
+		} else {
+			usage();
+		}
+	}
+
+	if (stats.enabled)
+		atexit(report_stats);
+
+	if (batch) {
+		// the profiler and input streams belong to a single program
+		if (paths.empty() || profiler.enabled || stream_fd >= 0 || bench_repeats > 0
+				|| !program_path.empty() || pipeline_tokens > 0 || !binary_path.empty()
+				|| !cpp_path.empty() || gradient || !inputs_path.empty())
+			usage();
+
+		batch_options opts;
+		opts.jobs = jobs;
+		opts.out_dir = batch_out;
+		opts.lazy = lazy;
+		opts.memo_capacity = memo_capacity;
+		return run_batch(paths, opts);
+	}
+	if (!paths.empty())
+		usage();
+
+	// only a program read from standard input is scanned while it is parsed
+	if (pipeline_tokens > 0 && (!program_path.empty() || bench_repeats > 0))
+		usage();
+
+	// binary results are sized before the first statement runs, which an
+	// input stream would have to wait on
+	if (binary_header && binary_path.empty())
+		usage();
+	if (!binary_path.empty() && (stream_fd >= 0 || bench_repeats > 0))
+		usage();
+
+	// generated code reads its inputs at run time and prints text
+	if (!cpp_path.empty() && (stream_fd >= 0 || bench_repeats > 0 || !binary_path.empty()))
+		usage();
+
+	// inputs come from one place past the input section, and generated code
+	// reads them from standard input
+	if (!inputs_path.empty() && (stream_fd >= 0 || bench_repeats > 0 || !cpp_path.empty()))
+		usage();
+
+	// gradients are printed as text by the interpreter
+	if (gradient && (bench_repeats > 0 || !binary_path.empty() || !cpp_path.empty()))
+		usage();
+
+	// standard input cannot hold both the program and the input stream
+	if (stream_fd == 0 && program_path.empty()) {
+		cerr << "--stream-inputs without a descriptor needs --program\n";
+		return 1;
+	}
+
+	ifstream program_file;
+	if (!program_path.empty()) {
+		program_file.open(program_path.c_str());
+		if (!program_file) {
+			cerr << "cannot open " << program_path << "\n";
+			return 1;
+		}
+	}
+	istream& program = program_path.empty() ? cin : program_file;
+
+	if (bench_repeats > 0)
+		return run_benchmark(program, bench_repeats, jobs);
+
+	// lexing on several threads needs the whole program in memory, and
+	// so does a program that is not on standard input
+	string text;
+	if (pipeline_tokens == 0 && (jobs > 1 || !program_path.empty())) {
+		string error;
+		if (!read_program(program, text, error)) {
+			cerr << "cannot decompress the program: " << error << "\n";
+			return 1;
+		}
+	}
+
+	// everything that can fail is opened before a pipelined parser starts
+	// its scanner thread, so no early return leaves it reading standard
+	// input while static destructors run
+	InputFile inputs;
+	if (!inputs_path.empty() && !inputs.Open(inputs_path)) {
+		cerr << "cannot map " << inputs_path << " as 32-bit integers\n";
+		return 1;
+	}
+
+	ofstream cpp_file;
+	if (!cpp_path.empty()) {
+		cpp_file.open(cpp_path.c_str());
+		if (!cpp_file) {
+			cerr << "cannot open " << cpp_path << "\n";
+			return 1;
+		}
+	}
+
+	ResultWriter results;
+	if (!binary_path.empty() && !results.Open(binary_path, binary_header)) {
+		cerr << "cannot open " << binary_path << "\n";
+		return 1;
+	}
+
+	Parser* parser;
+	if (pipeline_tokens > 0) {
+		parser = new Parser(pipeline_tokens);
+		parser->set_jobs(jobs);
+	} else if (text.empty() && program_path.empty()) {
+		parser = new Parser();
+	} else {
+		parser = new Parser(text, jobs);
+	}
+
+	parser->set_lazy(lazy);
+	parser->set_gradient(gradient);
+	if (memo_capacity > 0)
+		parser->set_memo(memo_capacity);
+	if (stream_fd >= 0)
+		parser->set_input_stream(new ValueReader(stream_fd));
+
+	if (!inputs_path.empty())
+		parser->set_input_file(&inputs);
+	if (!cpp_path.empty())
+		parser->set_code_output(&cpp_file);
+	if (!binary_path.empty())
+		parser->set_result_writer(&results);
+
+	try {
+		parser->parse_input();
+	} catch (parse_exit& e) {
+		// an error can stop the parser before the scanner reaches the end
+		// of the input; deleting the parser cancels and joins it
+		if (pipeline_tokens > 0)
+			delete parser;
+		// no code for a program with errors
+		if (!cpp_path.empty()) {
+			cpp_file.close();
+			remove(cpp_path.c_str());
+		}
+		return e.status;
+	}
+
+	if (!cpp_path.empty() && !cpp_file.flush()) {
+		cerr << "cannot write " << cpp_path << "\n";
+		return 1;
+	}
+	if (!results.Finish()) {
+		cerr << "cannot write results to " << binary_path << "\n";
+		return 1;
+	}
+
+	if (profiler.enabled) {
+		profiler.summary();
+		if (!profiler.write(profile_path)) {
+			cerr << "cannot write profile to " << profile_path << "\n";
+			return 1;
+		}
+	}
+
+	return(0);
+}
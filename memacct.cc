@@ -0,0 +1,222 @@
+/*
+ * Allocation accounting by subsystem, reported by --memory
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "memacct.h"
+
+using namespace std;
+
+memory_accounting memacct;
+
+thread_local MemTag mem_tag = MEM_OTHER;
+
+static const char* tag_names[MEM_COUNT] = {
+	"other", "lexer", "tokens", "ast", "symbols", "inputs", "output",
+	"optimizer", "evaluation"
+};
+
+memory_accounting::memory_accounting() {
+	enabled = false;
+	json = false;
+	table = NULL;
+	capacity = 0;
+	used = 0;
+	for (int i = 0; i < MEM_COUNT; i++)
+		usage[i] = mem_usage();
+	total = mem_usage();
+	allocations_ever = 0;
+}
+
+static inline size_t slot_of(void* p, size_t capacity) {
+	// blocks are at least 16-byte aligned, so the low bits carry nothing
+	size_t h = (size_t) p >> 4;
+	h *= 0x9E3779B97F4A7C15ull;
+	return (h >> 16) & (capacity - 1);
+}
+
+// doubles the table, keeping it at most half full
+void memory_accounting::grow() {
+	size_t old_capacity = capacity;
+	slot* old_table = table;
+
+	capacity = old_capacity == 0 ? 4096 : 2 * old_capacity;
+	table = (slot*) calloc(capacity, sizeof(slot));
+	if (table == NULL)
+		abort();
+
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (old_table[i].p == NULL)
+			continue;
+		size_t j = slot_of(old_table[i].p, capacity);
+		while (table[j].p != NULL)
+			j = (j + 1) & (capacity - 1);
+		table[j] = old_table[i];
+	}
+	free(old_table);
+}
+
+void memory_accounting::charge(MemTag tag, long bytes, long count) {
+	mem_usage* counters[2] = { &usage[tag], &total };
+
+	for (auto u : counters) {
+		u->bytes += bytes;
+		u->allocations += count;
+		if (u->bytes > u->peak)
+			u->peak = u->bytes;
+		if (u->bytes > u->max)
+			u->max = u->bytes;
+	}
+}
+
+void memory_accounting::record(void* p, size_t bytes) {
+	lock_guard<mutex> guard(lock);
+
+	if (2 * (used + 1) > capacity)
+		grow();
+
+	size_t i = slot_of(p, capacity);
+	while (table[i].p != NULL)
+		i = (i + 1) & (capacity - 1);
+	table[i].p = p;
+	table[i].bytes = bytes;
+	table[i].tag = mem_tag;
+	used++;
+
+	charge(mem_tag, bytes, 1);
+	allocations_ever++;
+}
+
+void memory_accounting::forget(void* p) {
+	lock_guard<mutex> guard(lock);
+
+	if (capacity == 0)
+		return;
+
+	size_t i = slot_of(p, capacity);
+	while (table[i].p != p) {
+		if (table[i].p == NULL)
+			return;
+		i = (i + 1) & (capacity - 1);
+	}
+
+	charge(table[i].tag, -(long) table[i].bytes, -1);
+	used--;
+
+	// backward shift deletion: move later entries of the probe sequence
+	// into the hole unless that would put them before their home slot
+	size_t hole = i;
+	for (size_t j = (i + 1) & (capacity - 1); table[j].p != NULL; j = (j + 1) & (capacity - 1)) {
+		size_t home = slot_of(table[j].p, capacity);
+		if (((j - home) & (capacity - 1)) >= ((j - hole) & (capacity - 1))) {
+			table[hole] = table[j];
+			hole = j;
+		}
+	}
+	table[hole].p = NULL;
+}
+
+// Prints live bytes and allocations, in total and per subsystem, and the
+// most bytes that were live since the previous report, on one line of
+// stderr as key=value pairs or as a JSON object. max is the most bytes
+// live at any point so far.
+void memory_accounting::report(const char* phase) {
+	lock_guard<mutex> guard(lock);
+
+	if (json) {
+		fprintf(stderr, "{\"phase\": \"%s\", \"bytes\": %ld, \"allocations\": %ld, "
+				"\"peak\": %ld, \"max\": %ld, \"allocations_ever\": %ld",
+				phase, total.bytes, total.allocations, total.peak, total.max, allocations_ever);
+		for (int i = 0; i < MEM_COUNT; i++) {
+			fprintf(stderr, ", \"%s\": {\"bytes\": %ld, \"allocations\": %ld, \"peak\": %ld}",
+					tag_names[i], usage[i].bytes, usage[i].allocations, usage[i].peak);
+		}
+		fprintf(stderr, "}\n");
+	} else {
+		fprintf(stderr, "memory: phase=%s bytes=%ld allocations=%ld peak=%ld max=%ld allocations_ever=%ld",
+				phase, total.bytes, total.allocations, total.peak, total.max, allocations_ever);
+		for (int i = 0; i < MEM_COUNT; i++) {
+			fprintf(stderr, " %s_bytes=%ld %s_allocations=%ld %s_peak=%ld",
+					tag_names[i], usage[i].bytes, tag_names[i], usage[i].allocations,
+					tag_names[i], usage[i].peak);
+		}
+		fprintf(stderr, "\n");
+	}
+
+	for (int i = 0; i < MEM_COUNT; i++)
+		usage[i].peak = usage[i].bytes;
+	total.peak = total.bytes;
+}
+
+//////////////////////////////////////////////////////
+// Replacement allocation functions
+//////////////////////////////////////////////////////
+
+// with accounting off these cost a predictable branch over malloc()/free()
+
+static void* allocate(size_t bytes) {
+	void* p = malloc(bytes == 0 ? 1 : bytes);
+	if (p == NULL)
+		throw bad_alloc();
+	if (memacct.enabled)
+		memacct.record(p, bytes);
+	return p;
+}
+
+static void deallocate(void* p) {
+	if (p == NULL)
+		return;
+	if (memacct.enabled)
+		memacct.forget(p);
+	free(p);
+}
+
+void* operator new(size_t bytes) {
+	return allocate(bytes);
+}
+
+void* operator new[](size_t bytes) {
+	return allocate(bytes);
+}
+
+void* operator new(size_t bytes, const nothrow_t&) noexcept {
+	try {
+		return allocate(bytes);
+	} catch (bad_alloc&) {
+		return NULL;
+	}
+}
+
+void* operator new[](size_t bytes, const nothrow_t&) noexcept {
+	try {
+		return allocate(bytes);
+	} catch (bad_alloc&) {
+		return NULL;
+	}
+}
+
+void operator delete(void* p) noexcept {
+	deallocate(p);
+}
+
+void operator delete[](void* p) noexcept {
+	deallocate(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	deallocate(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	deallocate(p);
+}
+
+void operator delete(void* p, const nothrow_t&) noexcept {
+	deallocate(p);
+}
+
+void operator delete[](void* p, const nothrow_t&) noexcept {
+	deallocate(p);
+}
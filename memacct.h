@@ -0,0 +1,78 @@
+/*
+ * Allocation accounting by subsystem, reported by --memory
+ */
+#ifndef __MEMACCT_H__
+#define __MEMACCT_H__
+
+#include <cstddef>
+#include <mutex>
+
+// subsystems allocations are charged to
+typedef enum { MEM_OTHER = 0, MEM_LEXER, MEM_TOKENS, MEM_AST, MEM_SYMBOLS,
+    MEM_INPUTS, MEM_OUTPUT, MEM_OPTIMIZER, MEM_EVALUATION, MEM_COUNT
+    } MemTag;
+
+// the subsystem the current thread's allocations are charged to
+extern thread_local MemTag mem_tag;
+
+typedef struct mem_usage {
+	long bytes;			// live bytes
+	long allocations;	// live allocations
+	long peak;			// most live bytes since the last report
+	long max;			// most live bytes ever
+} mem_usage;
+
+// While enabled, every operator new records the block's size and the
+// current thread's subsystem in a side table, and operator delete charges
+// the block back to the subsystem that allocated it. Blocks allocated while
+// accounting was off are not in the table and are ignored when freed.
+class memory_accounting {
+  public:
+	bool enabled;
+	bool json;
+
+	void record(void* p, size_t bytes);
+	void forget(void* p);
+	void report(const char* phase);
+	memory_accounting();
+
+  private:
+	// open addressing with linear probing; allocated with calloc() so that
+	// the table does not account for itself
+	struct slot {
+		void* p;
+		size_t bytes;
+		MemTag tag;
+	};
+
+	std::mutex lock;
+	slot* table;
+	size_t capacity;	// a power of two
+	size_t used;
+	mem_usage usage[MEM_COUNT];
+	mem_usage total;
+	long allocations_ever;
+
+	void grow();
+	void charge(MemTag tag, long bytes, long count);
+};
+
+extern memory_accounting memacct;
+
+// charges the allocations the current thread makes in the enclosing scope
+// to tag, e.g. mem_scope scope(MEM_AST);
+class mem_scope {
+  public:
+	mem_scope(MemTag tag) {
+		saved = mem_tag;
+		mem_tag = tag;
+	}
+	~mem_scope() {
+		mem_tag = saved;
+	}
+
+  private:
+	MemTag saved;
+};
+
+#endif
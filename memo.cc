@@ -0,0 +1,60 @@
+/*
+ * Bounded cache of polynomial evaluation results
+ */
+#include "memo.h"
+#include "stats.h"
+
+using namespace std;
+
+bool memo_key::operator==(const memo_key& other) const {
+	return poly == other.poly && args == other.args;
+}
+
+// FNV-1a over the polynomial index and the argument values
+size_t memo_key_hash::operator()(const memo_key& key) const {
+	size_t h = 14695981039346656037ULL;
+
+	h = (h ^ (unsigned int) key.poly) * 1099511628211ULL;
+	for (auto v : key.args)
+		h = (h ^ (unsigned int) v) * 1099511628211ULL;
+
+	return h;
+}
+
+EvalCache::EvalCache(size_t capacity)
+{
+    this->capacity = capacity > 0 ? capacity : 1;
+}
+
+// sets value to the cached result of key and marks it most recently used
+bool EvalCache::Lookup(const memo_key& key, int& value)
+{
+    auto it = index.find(key);
+
+    if (it == index.end()) {
+        STATS_ADD(memo_misses, 1);
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    value = it->second->second;
+    STATS_ADD(memo_hits, 1);
+    return true;
+}
+
+// caches the result of a call that missed, evicting the least recently
+// used entry if the cache is full
+void EvalCache::Insert(const memo_key& key, int value)
+{
+    if (index.count(key) > 0)
+        return;
+
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+        STATS_ADD(memo_evictions, 1);
+    }
+
+    entries.push_front(make_pair(key, value));
+    index[key] = entries.begin();
+}
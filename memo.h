@@ -0,0 +1,41 @@
+/*
+ * Bounded cache of polynomial evaluation results
+ */
+#ifndef __MEMO_H__
+#define __MEMO_H__
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// a call with every argument resolved to its value
+typedef struct memo_key {
+	int poly;
+	std::vector<int> args;
+
+	bool operator==(const memo_key& other) const;
+} memo_key;
+
+struct memo_key_hash {
+	size_t operator()(const memo_key& key) const;
+};
+
+// Maps calls to their results, evicting the least recently used entry once
+// capacity entries are held
+class EvalCache {
+  public:
+    bool Lookup(const memo_key& key, int& value);
+    void Insert(const memo_key& key, int value);
+    EvalCache(size_t capacity);
+
+  private:
+    typedef std::list<std::pair<memo_key, int>> entry_list;
+
+    size_t capacity;
+    entry_list entries;		// most recently used first
+    std::unordered_map<memo_key, entry_list::iterator, memo_key_hash> index;
+};
+
+#endif  //__MEMO_H__
@@ -0,0 +1,581 @@
+/*
+ * Optimization passes that rewrite parsed polynomials
+ * before the program is executed.
+ */
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <string>
+#include "kernels.h"
+#include "parser.h"
+#include "profiler.h"
+#include "univariate.h"
+
+using namespace std;
+
+// a monomial in canonical form: (parameter index, exponent) pairs sorted by
+// parameter index, with every parameter appearing at most once
+typedef vector<pair<int, int>> mono_key;
+
+// orders canonical monomials by total degree (highest first) and then
+// lexicographically, so normalized bodies read like textbook polynomials
+struct mono_key_order {
+	bool operator()(const mono_key& a, const mono_key& b) const {
+		int deg_a = 0;
+		int deg_b = 0;
+
+		for (auto& it : a)
+			deg_a += it.second;
+		for (auto& it : b)
+			deg_b += it.second;
+
+		if (deg_a != deg_b)
+			return deg_a > deg_b;
+
+		for (int i = 0; i < a.size() && i < b.size(); i++) {
+			if (a[i].first != b[i].first)
+				return a[i].first < b[i].first;
+			if (a[i].second != b[i].second)
+				return a[i].second > b[i].second;
+		}
+
+		return a.size() < b.size();
+	}
+};
+
+// a polynomial as a map from canonical monomial to (wrap-around) coefficient
+typedef map<mono_key, unsigned int, mono_key_order> sparse_poly;
+
+// replaces the body of p with the non-zero terms of sp, in canonical order
+static void set_polynomial_body(polynomial* p, const sparse_poly& sp) {
+	for (auto curr_term : p->polynomial_body) {
+		for (auto curr_mon : curr_term->m_list)
+			delete curr_mon;
+		delete curr_term;
+	}
+	p->polynomial_body.clear();
+
+	for (auto& it : sp) {
+		if (it.second == 0)
+			continue;
+
+		term* tr = new term;
+		tr->coefficient = (int) it.second;
+		for (auto& var : it.first) {
+			monomial* m = new monomial;
+			m->var_name = var.first;
+			m->exp = var.second;
+			tr->m_list.push_back(m);
+		}
+
+		if (!p->polynomial_body.empty())
+			p->polynomial_body.back()->op = '+';
+		p->polynomial_body.push_back(tr);
+	}
+}
+
+// runs every pass that rewrites the program after it passed its checks
+void Parser::optimize_program(stmt* start) {
+	compile_referenced(start);
+	inline_compositions(start);
+	select_kernels();
+	find_runs(start);
+}
+
+//////////////////////////////////////////////////////
+// Lazy bodies
+//////////////////////////////////////////////////////
+
+// builds the bodies of the polynomials a call tree refers to
+static void compile_call(poly_eval* pe, Parser* parser, vector<polynomial*>& p_table,
+		vector<char>& seen) {
+	if (!seen[pe->poly]) {
+		seen[pe->poly] = 1;
+		parser->compile_polynomial_body(p_table[pe->poly]);
+	}
+
+	for (auto a : *pe->alist) {
+		if (a->etype == POLY)
+			compile_call(a->peval, parser, p_table, seen);
+	}
+}
+
+// Builds every body that a statement refers to and that the declaration
+// section left for later (see set_lazy), so the passes below see it.
+// Bodies no statement refers to are never built.
+void Parser::compile_referenced(stmt* start) {
+	vector<char> seen(p_table.size());
+
+	for (stmt* pc = start->next; pc != NULL; pc = pc->next) {
+		if (pc->stmt_type == POLY)
+			compile_call(pc->pe, this, p_table, seen);
+	}
+}
+
+//////////////////////////////////////////////////////
+// Normalization
+//////////////////////////////////////////////////////
+
+// Rewrites a polynomial body into canonical form: repeated variables within a
+// monomial are merged by summing exponents, ^0 factors are dropped, like terms
+// are combined and terms whose coefficient cancels to 0 are removed.
+//
+// The sign of a term is carried by the op of the term before it, so the
+// rebuilt body stores signed coefficients joined by '+'. Coefficients are
+// summed with the same wrap-around arithmetic evaluate_polynomial uses.
+void Parser::normalize_polynomial(polynomial* p) {
+	sparse_poly combined;
+	char sign = '+';
+
+	for (auto curr_term : p->polynomial_body) {
+		map<int, int> exps;
+
+		for (auto curr_mon : curr_term->m_list) {
+			// undeclared variables are reported as error code 2, leave as is
+			if (curr_mon->var_name < 0)
+				return;
+			exps[curr_mon->var_name] += curr_mon->exp;
+		}
+
+		mono_key key;
+		for (auto& it : exps) {
+			if (it.second != 0)
+				key.push_back(it);
+		}
+
+		unsigned int coefficient = (unsigned int) curr_term->coefficient;
+		if (sign == '-')
+			combined[key] -= coefficient;
+		else
+			combined[key] += coefficient;
+
+		sign = curr_term->op;
+	}
+
+	set_polynomial_body(p, combined);
+}
+
+//////////////////////////////////////////////////////
+// Composition inlining
+//////////////////////////////////////////////////////
+
+// upper bound on the number of terms a synthesized composition may have
+#define MAX_COMPOSED_TERMS 4096
+
+// multiplies two canonical monomials by merging their exponent lists
+static mono_key mono_mul(const mono_key& a, const mono_key& b) {
+	mono_key result;
+	int i = 0;
+	int j = 0;
+
+	while (i < a.size() || j < b.size()) {
+		if (j == b.size() || (i < a.size() && a[i].first < b[j].first)) {
+			result.push_back(a[i++]);
+		} else if (i == a.size() || b[j].first < a[i].first) {
+			result.push_back(b[j++]);
+		} else {
+			result.push_back(make_pair(a[i].first, a[i].second + b[j].second));
+			i++;
+			j++;
+		}
+	}
+
+	return result;
+}
+
+// out = a * b; returns false if the product grows past limit terms
+static bool poly_mul(const sparse_poly& a, const sparse_poly& b, sparse_poly& out, long limit) {
+	sparse_poly product;
+
+	for (auto& x : a) {
+		for (auto& y : b) {
+			mono_key key = mono_mul(x.first, y.first);
+			unsigned int& c = product[key];
+			c += x.second * y.second;
+			if (c == 0)
+				product.erase(key);
+		}
+		if (product.size() > limit)
+			return false;
+	}
+
+	out.swap(product);
+	return true;
+}
+
+// out = base ^ exp by repeated squaring; returns false on term blow-up
+static bool poly_pow(const sparse_poly& base, int exp, sparse_poly& out, long limit) {
+	sparse_poly result;
+	result[mono_key()] = 1;
+
+	// a single monomial is raised by scaling its exponents
+	if (base.size() == 1 && exp > 0) {
+		mono_key key = base.begin()->first;
+		for (auto& it : key)
+			it.second *= exp;
+		result.clear();
+		result[key] = int_pow((int) base.begin()->second, exp);
+		out.swap(result);
+		return true;
+	}
+
+	sparse_poly b = base;
+	while (exp > 0) {
+		if (exp & 1) {
+			if (!poly_mul(result, b, result, limit))
+				return false;
+		}
+		exp >>= 1;
+		if (exp > 0 && !poly_mul(b, b, b, limit))
+			return false;
+	}
+
+	out.swap(result);
+	return true;
+}
+
+// Number of multiplications evaluate_polynomial performs for pe: one per
+// term and per monomial of the called body, plus what each nested argument
+// costs, once. select_kernels() runs after inlining and gives nearly every
+// body a kernel, and a body with a kernel has its arguments evaluated once,
+// up front, however many monomials refer to them.
+static long eval_cost(poly_eval* pe, const vector<polynomial*>& p_table) {
+	long cost = 0;
+
+	for (auto curr_term : p_table[pe->poly]->polynomial_body)
+		cost += 1 + curr_term->m_list.size();
+
+	for (auto a : *pe->alist) {
+		if (a->etype == POLY)
+			cost += eval_cost(a->peval, p_table);
+	}
+
+	return cost;
+}
+
+// builds the shape of a call tree, e.g. "F(X(#,#),#)", where # is a leaf
+// argument (ID or NUM); calls with the same shape share a composition
+static string composition_signature(poly_eval* pe, const vector<polynomial*>& p_table) {
+	string sig = p_table[pe->poly]->name + "(";
+
+	for (int i = 0; i < pe->alist->size(); i++) {
+		arg* a = (*pe->alist)[i];
+		if (i > 0)
+			sig += ",";
+		if (a->etype == POLY)
+			sig += composition_signature(a->peval, p_table);
+		else
+			sig += "#";
+	}
+
+	return sig + ")";
+}
+
+// appends the leaf arguments of a call tree in left-to-right order
+static void collect_leaves(poly_eval* pe, vector<arg*>& leaves) {
+	for (auto a : *pe->alist) {
+		if (a->etype == POLY)
+			collect_leaves(a->peval, leaves);
+		else
+			leaves.push_back(a);
+	}
+}
+
+// deletes the argument list of pe and the calls nested in it, but not the
+// leaf arguments, which collect_leaves() handed to the composed call
+static void delete_nested_calls(poly_eval* pe) {
+	for (auto a : *pe->alist) {
+		if (a->etype == POLY) {
+			delete_nested_calls(a->peval);
+			delete a->peval;
+			delete a;
+		}
+	}
+	delete pe->alist;
+}
+
+// Expands the call tree rooted at pe into a polynomial over its leaf
+// arguments. Leaves are numbered in left-to-right order and appended to
+// leaves; returns false if any intermediate result exceeds limit terms.
+static bool expand_composition(poly_eval* pe, const vector<polynomial*>& p_table,
+		vector<arg*>& leaves, sparse_poly& out, long limit) {
+	vector<sparse_poly> params;
+
+	for (auto a : *pe->alist) {
+		sparse_poly sp;
+		if (a->etype == POLY) {
+			if (!expand_composition(a->peval, p_table, leaves, sp, limit))
+				return false;
+		} else {
+			mono_key key;
+			key.push_back(make_pair((int) leaves.size(), 1));
+			sp[key] = 1;
+			leaves.push_back(a);
+		}
+		params.push_back(sp);
+	}
+
+	sparse_poly result;
+	char sign = '+';
+
+	for (auto curr_term : p_table[pe->poly]->polynomial_body) {
+		sparse_poly tp;
+		tp[mono_key()] = (unsigned int) curr_term->coefficient;
+
+		for (auto curr_mon : curr_term->m_list) {
+			sparse_poly factor;
+			if (!poly_pow(params[curr_mon->var_name], curr_mon->exp, factor, limit))
+				return false;
+			if (!poly_mul(tp, factor, tp, limit))
+				return false;
+		}
+
+		for (auto& it : tp) {
+			unsigned int& c = result[it.first];
+			if (sign == '-')
+				c -= it.second;
+			else
+				c += it.second;
+		}
+		if (result.size() > limit)
+			return false;
+
+		sign = curr_term->op;
+	}
+
+	out.swap(result);
+	return true;
+}
+
+// Finds evaluation statements whose arguments are themselves evaluations
+// (e.g. F(X(5, G))) and, for every call shape that occurs more than once,
+// synthesizes one composed polynomial over the leaf arguments. The calls are
+// then rewritten to evaluate the composition directly, as long as the
+// expansion is cheaper than the nested evaluation it replaces.
+//
+// Gradients are taken with respect to the parameters of the polynomial a
+// statement calls, so statements are left alone in gradient mode, and so
+// they are while profiling, which reports the nested calls as written.
+void Parser::inline_compositions(stmt* start) {
+	map<string, vector<stmt*>> shapes;
+
+	if (gradient || profiler.enabled)
+		return;
+
+	for (stmt* pc = start->next; pc != NULL; pc = pc->next) {
+		if (pc->stmt_type != POLY)
+			continue;
+
+		bool nested = false;
+		for (auto a : *pc->pe->alist)
+			nested = nested || (a->etype == POLY);
+
+		if (nested)
+			shapes[composition_signature(pc->pe, p_table)].push_back(pc);
+	}
+
+	for (auto& shape : shapes) {
+		if (shape.second.size() < 2)
+			continue;
+
+		poly_eval* first = shape.second[0]->pe;
+		vector<arg*> leaves;
+		sparse_poly composed;
+
+		// every term costs at least one multiplication, so expansions with
+		// more terms than the nested evaluation costs are abandoned early
+		long limit = min((long) MAX_COMPOSED_TERMS, eval_cost(first, p_table));
+
+		if (!expand_composition(first, p_table, leaves, composed, limit))
+			continue;
+
+		polynomial* p = new polynomial;
+		p->name = shape.first;
+		p->decl_lineno = first->lineno;
+		for (int i = 0; i < leaves.size(); i++)
+			p->add_param("#" + to_string(i));
+		set_polynomial_body(p, composed);
+
+		// composed cost: one multiplication per term and per monomial
+		long cost = 0;
+		for (auto curr_term : p->polynomial_body)
+			cost += 1 + curr_term->m_list.size();
+
+		if (cost > eval_cost(first, p_table)) {
+			set_polynomial_body(p, sparse_poly());
+			delete p;
+			continue;
+		}
+
+		int index = p_table.size();
+		p_table.push_back(p);
+
+		for (auto st : shape.second) {
+			vector<arg*>* alist = new vector<arg*>();
+			collect_leaves(st->pe, *alist);
+			delete_nested_calls(st->pe);
+			st->pe->poly = index;
+			st->pe->alist = alist;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////
+// Kernel selection
+//////////////////////////////////////////////////////
+
+// gives every polynomial with a large enough body a dense form, so that
+// evaluate_polynomial hands it to the vectorized kernel, and every other
+// polynomial with few parameters and low exponents a compact form for the
+// kernel specialized on its arity and maximum exponent. Both share powers
+// through a table. Anything else gets a schedule that computes each power
+// and each product shared by several terms once, and only a schedule too
+// large to build is left to the generic loop in evaluate_body
+void Parser::select_kernels() {
+	for (auto p : p_table) {
+		if (p->flat != NULL || p->small != NULL || p->chain != NULL || p->body_begin >= 0)
+			continue;
+
+		p->flat = build_flat_body(p);
+		if (p->flat == NULL)
+			p->small = build_small_body(p);
+		if (p->flat == NULL && p->small == NULL)
+			p->chain = build_chain_body(p);
+	}
+}
+
+//////////////////////////////////////////////////////
+// Runs
+//////////////////////////////////////////////////////
+
+// highest degree for which forward differencing is considered
+#define MAX_RUN_DEGREE 64
+
+// the constant argument of a call to a one-parameter polynomial, if pc is one
+static bool constant_call(stmt* pc, int& poly, unsigned int& x) {
+	if (pc->stmt_type != POLY || pc->pe->alist->size() != 1)
+		return false;
+
+	arg* a = (*pc->pe->alist)[0];
+	if (a->etype != NUM)
+		return false;
+
+	poly = pc->pe->poly;
+	x = (unsigned int) a->value;
+	return true;
+}
+
+// multiplications evaluate_polynomial spends on one call of p: one per
+// term, plus the squarings and multiplications of int_pow
+static long call_cost(const polynomial* p) {
+	long cost = 0;
+
+	for (auto curr_term : p->polynomial_body) {
+		cost += 1;
+		for (auto curr_mon : curr_term->m_list) {
+			for (int e = curr_mon->exp; e > 0; e >>= 1)
+				cost += 1 + (e & 1);
+		}
+	}
+
+	return cost;
+}
+
+// highest degree for which multipoint evaluation is considered, and the
+// lowest for which it beats a call per point
+#define MAX_MULTIPOINT_DEGREE (1 << 16)
+#define MIN_MULTIPOINT_DEGREE 1024
+
+// Multipoint evaluation of a degree d polynomial costs well under the d
+// multiplications per point of Horner's rule once d >= 1024, below which the
+// flat kernels are as fast, and only if at least d points share the
+// remainder tree.
+static bool multipoint_pays(const polynomial* p, long degree, long count) {
+	return degree >= MIN_MULTIPOINT_DEGREE && count >= degree && 4 * call_cost(p) >= 3 * degree;
+}
+
+// Finds consecutive statements that call the same one-parameter polynomial
+// at constant arguments, and marks them as runs that execute_program()
+// evaluates all at once.
+//
+// A long enough stretch of calls to a polynomial of high degree becomes a
+// single run evaluated by multipoint(). Otherwise the stretch is split into
+// runs at evenly spaced arguments, as in F(0); F(2); F(4); ..., for forward
+// differencing. A run of a degree d polynomial is worth it if it is long
+// enough to repay evaluating its first d + 1 points, and if d additions per
+// point are cheaper than a call.
+//
+// Runs are left alone while profiling, so every call is still measured, and
+// in gradient mode, as they only produce values.
+void Parser::find_runs(stmt* start) {
+	if (profiler.enabled || gradient)
+		return;
+
+	stmt* pc = start->next;
+
+	while (pc != NULL) {
+		int poly;
+		unsigned int x;
+		if (!constant_call(pc, poly, x)) {
+			pc = pc->next;
+			continue;
+		}
+
+		// the stretch of calls to poly at constant arguments
+		vector<unsigned int> points(1, x);
+		stmt* end = pc->next;
+		int next_poly;
+
+		while (end != NULL && constant_call(end, next_poly, x) && next_poly == poly) {
+			points.push_back(x);
+			end = end->next;
+		}
+
+		// too few points for multipoint evaluation need not look at high degrees
+		int max_degree = points.size() >= MIN_MULTIPOINT_DEGREE ? MAX_MULTIPOINT_DEGREE : MAX_RUN_DEGREE;
+		dense_poly f;
+		if (points.size() == 1 || !dense_univariate(p_table[poly], max_degree, f)) {
+			pc = end;
+			continue;
+		}
+
+		long degree = f.size() - 1;
+		if (multipoint_pays(p_table[poly], degree, points.size())) {
+			poly_run* run = new poly_run;
+			run->poly = poly;
+			run->count = points.size();
+			run->start = 0;
+			run->step = 0;
+			run->points.swap(points);
+			run->coefficients.swap(f);
+			pc->run = run;
+			pc = end;
+			continue;
+		}
+
+		// split the stretch into arithmetic progressions
+		bool differences = degree <= MAX_RUN_DEGREE && degree < 2 * call_cost(p_table[poly]);
+
+		for (int i = 0; i < points.size(); ) {
+			int count = 1;
+			unsigned int step = i + 1 < points.size() ? points[i + 1] - points[i] : 0;
+
+			while (i + count < points.size() && points[i + count] - points[i + count - 1] == step)
+				count++;
+
+			if (differences && count >= 2 * (degree + 1)) {
+				poly_run* run = new poly_run;
+				run->poly = poly;
+				run->count = count;
+				run->start = points[i];
+				run->step = step;
+				run->coefficients = f;
+				pc->run = run;
+			}
+
+			for (int k = 0; k < count; k++)
+				pc = pc->next;
+			i += count;
+		}
+	}
+}
@@ -11,11 +11,16 @@
 #include <cstdlib>
 #include <iostream>
 #include <map>
-#include <math.h>
 #include <memory>
 #include <vector>
 #include <string>
+#include <thread>
+#include "kernels.h"
+#include "memacct.h"
 #include "parser.h"
+#include "profiler.h"
+#include "stats.h"
+#include "univariate.h"
 
 using namespace std;
 
@@ -25,6 +30,8 @@ using namespace std;
 
 input_table::input_table() {
 	next_i = 0;
+	stream = NULL;
+	file = NULL;
 }
 
 // adds variable to var_map if it doesn't exist
@@ -41,6 +48,7 @@ int input_table::add_var(string var_name) {
 	}
 
 	if (!isInTable) {
+		mem_scope scope(MEM_SYMBOLS);
 		var_map.push_back(make_pair(var_name, -1));
 	}
 
@@ -53,7 +61,28 @@ void input_table::add_input(int in) {
 	return;
 }
 
-// returns index of variable (aka "str") in input_map
+// Sets value to the i-th input; returns false if a stream was set and it
+// ran out. Without a stream, inputs past the end of input_map and of the
+// input file read as 0. Inputs are consumed in order, so a stream is never
+// read ahead of need.
+bool input_table::read_input(int i, int& value) {
+	if (i < input_map.size()) {
+		value = input_map[i];
+		return true;
+	}
+	if (file != NULL) {
+		size_t k = i - input_map.size();
+		value = k < file->Count() ? file->Values()[k] : 0;
+		return true;
+	}
+	if (stream != NULL)
+		return stream->Next(value);
+
+	value = 0;
+	return true;
+}
+
+// returns index of variable (aka "str") in var_map
 int input_table::get_var(string str) {
 	for (int i = 0; i < var_map.size(); i++) {
 		if(var_map[i].first.compare(str) == 0) 
@@ -69,6 +98,7 @@ int input_table::get_var(string str) {
 //////////////////////////////////////////////////////
 
 void polynomial::add_param(string p) {
+	mem_scope scope(MEM_SYMBOLS);
 	param_names[param_i] = p;
 	param_i += 1;
 }
@@ -85,6 +115,11 @@ int polynomial::get_param(string p) {
 polynomial::polynomial() {
 	name = "";
 	param_i = 0;
+	flat = NULL;
+	small = NULL;
+	chain = NULL;
+	body_begin = -1;
+	STATS_ADD(ast_nodes, 1);
 }
 
 //////////////////////////////////////////////////////
@@ -94,6 +129,7 @@ polynomial::polynomial() {
 monomial::monomial() {
 	var_name = 0;
 	exp = 1;
+	STATS_ADD(ast_nodes, 1);
 }
 
 //////////////////////////////////////////////////////
@@ -103,6 +139,7 @@ monomial::monomial() {
 term::term() {
 	coefficient = 1;
 	op = 0;
+	STATS_ADD(ast_nodes, 1);
 }
 
 //////////////////////////////////////////////////////
@@ -111,6 +148,8 @@ term::term() {
 
 poly_eval::poly_eval() {
 	poly = 0;
+	alist = NULL;
+	STATS_ADD(ast_nodes, 1);
 }
 //
 //////////////////////////////////////////////////////
@@ -121,7 +160,8 @@ arg::arg() {
 	etype = POLY;
 	value = 0;
 	index = 0;
-	peval = new poly_eval();
+	peval = NULL;
+	STATS_ADD(ast_nodes, 1);
 }
 
 //////////////////////////////////////////////////////
@@ -132,10 +172,205 @@ stmt::stmt() {
 	stmt_type = INPUT;
 	pe = 0;
 	variable = 0;
+	run = 0;
 	next = 0;
+	STATS_ADD(ast_nodes, 1);
+}
+
+//////////////////////////////////////////////////////
+// Freeing the program
+//////////////////////////////////////////////////////
+
+static void delete_term(term* tr) {
+	for (auto curr_mon : tr->m_list)
+		delete curr_mon;
+	delete tr;
+}
+
+// deletes a polynomial with its body and the kernel forms built from it
+static void delete_polynomial(polynomial* p) {
+	for (auto curr_term : p->polynomial_body)
+		delete_term(curr_term);
+	delete p->flat;
+	delete p->small;
+	delete p->chain;
+	delete p;
+}
+
+// deletes a call with its argument list and every call nested in it
+static void delete_call(poly_eval* pe) {
+	if (pe == NULL)
+		return;
+
+	if (pe->alist != NULL) {
+		for (auto a : *pe->alist) {
+			delete_call(a->peval);
+			delete a;
+		}
+		delete pe->alist;
+	}
+	delete pe;
+}
+
+// deletes a statement list with the calls and runs of its statements
+// (iteratively, as lists can be long)
+static void delete_statements(stmt* st) {
+	while (st != NULL) {
+		stmt* next = st->next;
+		delete_call(st->pe);
+		delete st->run;
+		delete st;
+		st = next;
+	}
 }
 
 
+//////////////////////////////////////////////////////
+// Parser functions
+//////////////////////////////////////////////////////
+
+// reads the program from standard input
+Parser::Parser() {
+	errorno = 0;
+	out = &cout;
+	jobs = 1;
+	worker = false;
+	memo = NULL;
+	lazy = false;
+	results = NULL;
+	code = NULL;
+	gradient = false;
+	program = NULL;
+}
+
+// reads the program from text; text must stay alive while it is constructed
+Parser::Parser(const string& text) : lexer(text) {
+	errorno = 0;
+	out = &cout;
+	jobs = 1;
+	worker = false;
+	memo = NULL;
+	lazy = false;
+	results = NULL;
+	code = NULL;
+	gradient = false;
+	program = NULL;
+}
+
+// reads the program from text, lexing and parsing declarations on up to
+// jobs threads; text must stay alive while it is constructed
+Parser::Parser(const string& text, int jobs) : lexer(text, jobs) {
+	errorno = 0;
+	out = &cout;
+	this->jobs = jobs;
+	worker = false;
+	memo = NULL;
+	lazy = false;
+	results = NULL;
+	code = NULL;
+	gradient = false;
+	program = NULL;
+}
+
+// reads the program from standard input, scanning it on a thread of its own
+// while it is parsed; see LexicalAnalyzer(int)
+Parser::Parser(int queue_tokens) : lexer(queue_tokens) {
+	errorno = 0;
+	out = &cout;
+	jobs = 1;
+	worker = false;
+	memo = NULL;
+	lazy = false;
+	results = NULL;
+	code = NULL;
+	gradient = false;
+	program = NULL;
+}
+
+// a worker parses declarations in tokens [begin, end) of source for
+// parse_poly_decl_section_parallel(); it reports nothing itself
+Parser::Parser(const LexicalAnalyzer& source, int begin, int end) : lexer(source, begin, end) {
+	errorno = 0;
+	out = &cout;
+	jobs = 1;
+	worker = true;
+	memo = NULL;
+	lazy = false;
+	results = NULL;
+	code = NULL;
+	gradient = false;
+	program = NULL;
+}
+
+// frees everything the program was built into, including the polynomials
+// the optimizer added, so that one process can compile many programs
+Parser::~Parser() {
+	for (auto p : p_table)
+		delete_polynomial(p);
+	delete_statements(program);
+	delete memo;
+}
+
+// sets the stream results and errors are written to (cout by default)
+void Parser::set_output(ostream* os) {
+	out = os;
+}
+
+// Makes INPUT statements read from reader once the values in the input
+// section (which becomes optional) run out. Results are flushed whenever
+// the reader has to wait for more input
+void Parser::set_input_stream(ValueReader* reader) {
+	i_table.stream = reader;
+	reader->FlushBeforeWait(out);
+}
+
+// Makes INPUT statements read from file once the values in the input
+// section (which becomes optional) run out
+void Parser::set_input_file(InputFile* file) {
+	i_table.file = file;
+}
+
+// caches the results of up to capacity distinct calls, so that calls
+// repeating the polynomial and argument values of an earlier one (nested
+// calls included) are not evaluated again
+void Parser::set_memo(size_t capacity) {
+	delete memo;
+	memo = new EvalCache(capacity);
+}
+
+// In lazy mode declarations only have their bodies checked for syntax and
+// error code 2; a body is built the first time a statement refers to it
+void Parser::set_lazy(bool on) {
+	lazy = on;
+}
+
+// makes execute_program() hand results to writer instead of printing them
+void Parser::set_result_writer(ResultWriter* writer) {
+	results = writer;
+}
+
+// makes parse_input() write the program as C++ to os instead of running it;
+// the input section becomes optional, as the values are read at run time
+void Parser::set_code_output(ostream* os) {
+	code = os;
+}
+
+// In gradient mode every evaluation statement prints its value followed by
+// the partial derivatives with respect to each of the called polynomial's
+// parameters, on one line
+void Parser::set_gradient(bool on) {
+	gradient = on;
+}
+
+// sets the number of threads the declaration section may be parsed on
+void Parser::set_jobs(int n) {
+	jobs = n;
+}
+
+int Parser::token_count() {
+	return lexer.TokenCount();
+}
+
 //////////////////////////////////////////////////////
 // Error functions
 //////////////////////////////////////////////////////
@@ -143,9 +378,11 @@ stmt::stmt() {
 
 void Parser::syntax_error(int lineno)
 {
-    cout << "SYNTAX ERROR !&%!\n";
+    // the parser that started a worker reports the error
+    if (!worker)
+        *out << "SYNTAX ERROR !&%!\n";
 	//printf("called from line number: %d\n", lineno);
-    exit(1);
+    throw parse_exit{1};
 }
 
 // Error code 1 indicates that a polynomial has been declared more than once,
@@ -176,13 +413,13 @@ void Parser::checkE1() {
 	if (linenos.size() != 0) {
 		errorno = 1;
 		sort(linenos.begin(), linenos.end());
-		printf("Error Code 1: ");
+		*out << "Error Code 1: ";
 		for (int i = 0; i < linenos.size(); i++)
-			printf("%d ", linenos[i]);
+			*out << linenos[i] << ' ';
 	}
 
 	if (errorno != 0)
-		exit(1);
+		throw parse_exit{1};
 }
 
 
@@ -191,60 +428,60 @@ void Parser::checkE1() {
 // Note: not specifying arguments of a polynomial results in a default variable of "x",
 // so "F = x + y" would also trigger this error.
 void Parser::error_code_2() {
-	cout << "Error Code 2: ";
+	*out << "Error Code 2: ";
 
 	sort(error_t.begin(), error_t.end());
 
 	// print line numbers
 	for (int i = 0; i < error_t.size(); i++) {
-		printf("%d ", error_t[i]);
+		*out << error_t[i] << ' ';
 	}
 
-	exit(1);
+	throw parse_exit{1};
 }
 
 // Error code 3 indicates that a polynomial being attempted to be evaluated has not been declared.
 void Parser::error_code_3() {
-	cout << "Error Code 3: ";
+	*out << "Error Code 3: ";
 
 	sort(error_t.begin(), error_t.end());
 
 	// print line numbers
 	for (int i = 0; i < error_t.size(); i++) {
-		printf("%d ", error_t[i]);
+		*out << error_t[i] << ' ';
 	}
 
-	exit(1);
+	throw parse_exit{1};
 }
 
 // Error code 4 indicates that the number of arguments specified in a polynomial evaluation differs
 // from the declaration of said polynomial.
 void Parser::error_code_4() {
-	cout << "Error Code 4: ";
+	*out << "Error Code 4: ";
 
 	sort(error_t.begin(), error_t.end());
 
 	// print line numbers
 	for (int i = 0; i < error_t.size(); i++) {
-		printf("%d ", error_t[i]);
+		*out << error_t[i] << ' ';
 	}
 
-	exit(1);
+	throw parse_exit{1};
 }
 
 // Error code 5 indicates that an argument within a polynomial evaluation has not been initialized.
 // Note: if numerous violations happen on one line, output the line number twice.
 void Parser::error_code_5() {
-	cout << "Error Code 5: ";
+	*out << "Error Code 5: ";
 
 	sort(error_t.begin(), error_t.end());
 
 	// print line numbers
 	for (int i = 0; i < error_t.size(); i++) {
-		printf("%d ", error_t[i]);
+		*out << error_t[i] << ' ';
 	}
 
-	exit(1);
+	throw parse_exit{1};
 }
 
 // this function gets a token and checks if it is
@@ -284,17 +521,60 @@ void Parser::execute_program(stmt* start) {
 	int v;
 	pc = start->next;
 	int next_input = 0;
+
+	if (results != NULL) {
+		vector<int> linenos;
+		for (stmt* st = start->next; st != NULL; st = st->next) {
+			if (st->stmt_type == POLY)
+				linenos.push_back(st->pe->lineno);
+		}
+		results->Begin(linenos);
+	}
+
 	while (pc != NULL) {
+		// a run of statements prints all its results at once
+		if (pc->run != NULL) {
+			vector<unsigned int> values(pc->run->count);
+			if (pc->run->points.empty())
+				forward_differences(pc->run->coefficients, pc->run->start, pc->run->step, values);
+			else
+				multipoint(pc->run->coefficients, pc->run->points, values);
+			STATS_ADD(run_points, values.size());
+
+			for (auto value : values)
+				put_result((int) value);
+			for (int i = 1; i < values.size(); i++)
+				pc = pc->next;
+			pc = pc->next;
+			continue;
+		}
+
 		switch(pc->stmt_type) {
 			// case when poly-eval statement
 			case POLY:
+				if (gradient) {
+					vector<int> partials;
+					*out << evaluate_gradient(pc->pe, partials);
+					for (auto d : partials)
+						*out << ' ' << d;
+					*out << '\n';
+					break;
+				}
 				v = evaluate_polynomial(pc->pe);
-				cout << v << endl;
+				put_result(v);
 				break;
 
 			// case when input statement
 			case INPUT:
-				i_table.var_map[pc->variable].second = next_input;
+				if (!i_table.read_input(next_input, v)) {
+					out->flush();
+					if (i_table.stream->Error().empty())
+						cerr << "input stream ended before all INPUT statements were executed\n";
+					else
+						cerr << "malformed value in input stream: \"" << i_table.stream->Error() << "\"\n";
+					throw parse_exit{1};
+				}
+				i_table.var_map[pc->variable].second = v;
 				next_input += 1;
 				break;	
 		}
@@ -303,6 +583,28 @@ void Parser::execute_program(stmt* start) {
 	}
 }
 
+// prints the result of an evaluation statement, or hands it to the binary
+// result writer
+void Parser::put_result(int v) {
+	if (results != NULL)
+		results->Put(v);
+	else
+		*out << v << '\n';
+}
+
+// value of an argument of a polynomial evaluation
+int Parser::argument_value(arg* a) {
+	// handle case when argument == poly eval
+	if (a->etype == POLY)
+		return evaluate_polynomial(a->peval);
+	// handle case when arg == ID
+	else if (a->etype == ID)
+		return i_table.var_map[a->index].second;
+	// handle case when arg == NUM
+	else
+		return a->value;
+}
+
 int Parser::evaluate_polynomial(poly_eval* pe) {
 	int result = 0;
 	int curr_val = 1;
@@ -312,22 +614,40 @@ int Parser::evaluate_polynomial(poly_eval* pe) {
 
 	// get polynomial template
 	polynomial* pn = p_table[pe->poly];
+	if (pn->body_begin >= 0)
+		compile_polynomial_body(pn);
+	STATS_ADD(evaluations, 1);
+	if (profiler.enabled)
+		profiler.enter(pn, pe->lineno);
+
+	// bodies with a kernel of their own and cached calls, which are looked
+	// up by value, need every argument up front instead of evaluating them
+	// as monomials refer to them
+	if (pn->flat != NULL || pn->small != NULL || pn->chain != NULL || memo != NULL) {
+		memo_key key;
+		key.poly = pe->poly;
+		key.args.resize(pe->alist->size());
+		for (int i = 0; i < key.args.size(); i++)
+			key.args[i] = argument_value((*pe->alist)[i]);
+
+		if (memo == NULL || !memo->Lookup(key, result)) {
+			result = evaluate_body(pn, key.args.data());
+			if (memo != NULL)
+				memo->Insert(key, result);
+		}
+
+		if (profiler.enabled)
+			profiler.leave();
+		return result;
+	}
 
 	for (auto curr_term : pn->polynomial_body) {
+		STATS_ADD(monomials, curr_term->m_list.size());
 		if (curr_term->m_list.size() > 0) {
 			for (auto curr_mon : curr_term->m_list) {
-				// handle case when argument == poly eval
-				if ((*pe->alist)[curr_mon->var_name]->etype == POLY) {
-					op1 = evaluate_polynomial((*pe->alist)[curr_mon->var_name]->peval);
-				// handle case when arg == ID
-				} else if ((*pe->alist)[curr_mon->var_name]->etype == ID) {
-					op1 = i_table.input_map[i_table.var_map[(*pe->alist)[curr_mon->var_name]->index].second];
-				// handle case when arg == NUM
-				} else {
-					op1 = (*pe->alist)[curr_mon->var_name]->value;
-				}
-					op2 = (int)pow(op1, curr_mon->exp);
-					curr_val *= op2;
+				op1 = argument_value((*pe->alist)[curr_mon->var_name]);
+				op2 = int_pow(op1, curr_mon->exp);
+				curr_val *= op2;
 			}
 		} else {
 			curr_val = 1;
@@ -349,6 +669,107 @@ int Parser::evaluate_polynomial(poly_eval* pe) {
 		curr_val = 1;
 	}
 
+	if (profiler.enabled)
+		profiler.leave();
+	return result;
+}
+
+// Evaluates pe like evaluate_polynomial() and sets partials[i] to the partial
+// derivative with respect to parameter i at the same arguments, in one pass
+// over the body with dual numbers: each term carries its value and its
+// gradient, and a monomial x^e contributes x^e and e x^(e-1) from a single
+// power computation
+int Parser::evaluate_gradient(poly_eval* pe, vector<int>& partials) {
+	polynomial* pn = p_table[pe->poly];
+	if (pn->body_begin >= 0)
+		compile_polynomial_body(pn);
+	STATS_ADD(evaluations, 1);
+	if (profiler.enabled)
+		profiler.enter(pn, pe->lineno);
+
+	int arity = pe->alist->size();
+	vector<unsigned int> args(arity);
+	for (int i = 0; i < arity; i++)
+		args[i] = (unsigned int) argument_value((*pe->alist)[i]);
+
+	unsigned int result = 0;
+	vector<unsigned int> result_grad(arity, 0);
+	vector<unsigned int> term_grad(arity);
+	char op = 0;
+
+	for (auto curr_term : pn->polynomial_body) {
+		STATS_ADD(monomials, curr_term->m_list.size());
+		unsigned int term_val = 1;
+		fill(term_grad.begin(), term_grad.end(), 0);
+
+		// (term_val, term_grad) *= (x^e, e x^(e-1) dx)
+		for (auto curr_mon : curr_term->m_list) {
+			if (curr_mon->exp == 0)
+				continue;
+			unsigned int x = args[curr_mon->var_name];
+			unsigned int lower = (unsigned int) int_pow((int) x, curr_mon->exp - 1);
+			unsigned int power = lower * x;
+
+			for (auto& d : term_grad)
+				d *= power;
+			term_grad[curr_mon->var_name] += term_val * (unsigned int) curr_mon->exp * lower;
+			term_val *= power;
+		}
+
+		unsigned int c = (unsigned int) curr_term->coefficient;
+		if (op == '-')
+			c = -c;
+		result += c * term_val;
+		for (int i = 0; i < arity; i++)
+			result_grad[i] += c * term_grad[i];
+
+		op = curr_term->op;
+	}
+
+	partials.resize(arity);
+	for (int i = 0; i < arity; i++)
+		partials[i] = (int) result_grad[i];
+
+	if (profiler.enabled)
+		profiler.leave();
+	return (int) result;
+}
+
+// evaluates the body of pn with its parameters bound to args
+int Parser::evaluate_body(polynomial* pn, const int* args) {
+	if (pn->flat != NULL) {
+		STATS_ADD(monomials, pn->flat->monomials);
+		return evaluate_flat(pn->flat, args);
+	}
+	if (pn->small != NULL) {
+		STATS_ADD(monomials, pn->small->monomials);
+		return evaluate_small(pn->small, args);
+	}
+	if (pn->chain != NULL) {
+		STATS_ADD(monomials, pn->chain->monomials);
+		return evaluate_chain(pn->chain, args);
+	}
+
+	int result = 0;
+	int curr_val = 1;
+	char op = 0;
+
+	for (auto curr_term : pn->polynomial_body) {
+		STATS_ADD(monomials, curr_term->m_list.size());
+		for (auto curr_mon : curr_term->m_list)
+			curr_val *= int_pow(args[curr_mon->var_name], curr_mon->exp);
+
+		if (op == '-')
+			result -= curr_val * curr_term->coefficient;
+		else if (op == '+')
+			result += curr_val * curr_term->coefficient;
+		else
+			result = curr_val * curr_term->coefficient;
+
+		op = curr_term->op;
+		curr_val = 1;
+	}
+
 	return result;
 }
 
@@ -358,11 +779,47 @@ int Parser::evaluate_polynomial(poly_eval* pe) {
 
 // input -> program inputs
 void Parser::parse_input() {
-	errorno = 0;
-	stmt* st_list = parse_program();
-	parse_inputs();
-	bool hasErrors = false;
+	stmt* st_list;
+
+	{
+		phase_timer timer(PHASE_PARSE);
+		mem_scope scope(MEM_AST);
+		st_list = parse_program();
+		// with an input stream or file or when emitting C++ the input section
+		// may be left out
+		if ((i_table.stream == NULL && i_table.file == NULL && code == NULL)
+				|| lexer.peek(1).token_type != END_OF_FILE) {
+			mem_scope scope(MEM_INPUTS);
+			parse_inputs();
+		}
+	}
+	{
+		phase_timer timer(PHASE_CHECK);
+		mem_scope scope(MEM_AST);
+		check_program();
+	}
+
+	if (errorno == 0) {
+		{
+			phase_timer timer(PHASE_OPTIMIZE);
+			mem_scope scope(MEM_OPTIMIZER);
+			optimize_program(st_list);
+		}
+		if (code != NULL) {
+			mem_scope scope(MEM_OUTPUT);
+			emit_cpp(st_list, *code);
+			return;
+		}
+		phase_timer timer(PHASE_EXECUTE);
+		mem_scope scope(MEM_EVALUATION);
+		execute_program(st_list);
+	}
+
+}
 
+// reports the first class of errors found while parsing and throws
+// parse_exit, returns normally only if the program can be executed
+void Parser::check_program() {
 	Token t = lexer.peek(1);
 
 	if (t.token_type != END_OF_FILE)
@@ -385,10 +842,6 @@ void Parser::parse_input() {
 			error_code_5();
 			break;
 	}
-
-	if (errorno == 0)
-		execute_program(st_list);
-
 }
 
 // program -> poly_decl_section start
@@ -399,54 +852,234 @@ stmt* Parser::parse_program() {
 }
 
 // poly_decl_section -> poly_decl | poly_decl poly_decl_section
+// (parsed iteratively so that long sections do not exhaust the stack)
 void Parser::parse_poly_decl_section() {
-	p_table.push_back(parse_poly_decl());
+	Token t;
 
-	Token t = lexer.peek(1);
+	if (jobs > 1 && parse_poly_decl_section_parallel())
+		return;
+
+	do {
+		p_table.push_back(parse_poly_decl());
+		STATS_ADD(polynomials, 1);
+		t = lexer.peek(1);
 
 	// determine if poly_decl_section via: POLY
-	if (t.token_type == POLY) {
-		parse_poly_decl_section();
-		return;
+	} while (t.token_type == POLY);
+}
+
+// fewest declarations worth starting threads for
+#define MIN_PARALLEL_DECLS 256
+
+// Parses the declaration section on up to jobs threads. A declaration is
+// self-contained up to its SEMICOLON, so the tokens before START are split at
+// top-level POLY tokens into contiguous groups of about equal size, each
+// parsed by a worker. Their tables are merged back in source order, which
+// keeps line numbers and error code 2 reports identical to a sequential
+// parse. A malformed declaration anywhere is a syntax error either way.
+//
+// Returns false without consuming any token if the section is too small to
+// split or not followed by START; the sequential parser then handles it.
+bool Parser::parse_poly_decl_section_parallel() {
+	int begin = lexer.GetIndex();
+	int end = begin;
+	vector<int> decls;
+
+	for (; end < lexer.TokenCount(); end++) {
+		TokenType type = lexer.TokenAt(end).token_type;
+		if (type == START)
+			break;
+		if (type == POLY)
+			decls.push_back(end);
 	}
+
+	if (end == lexer.TokenCount() || decls.size() < MIN_PARALLEL_DECLS || decls[0] != begin)
+		return false;
+
+	vector<int> bounds;
+	bounds.push_back(begin);
+	for (int w = 1; w < jobs; w++) {
+		int target = begin + (long) (end - begin) * w / jobs;
+		auto d = lower_bound(decls.begin(), decls.end(), target);
+		if (d != decls.end() && *d > bounds.back())
+			bounds.push_back(*d);
+	}
+	bounds.push_back(end);
+
+	int n = bounds.size() - 1;
+	vector<Parser*> workers;
+	vector<thread> threads;
+	vector<char> ok(n);
+
+	for (int i = 0; i < n; i++) {
+		workers.push_back(new Parser(lexer, bounds[i], bounds[i + 1]));
+		workers[i]->lazy = lazy;
+	}
+	for (int i = 0; i < n; i++)
+		threads.push_back(thread([&workers, &ok, i]() {
+			mem_scope scope(MEM_AST);
+			ok[i] = workers[i]->parse_worker_declarations();
+		}));
+	for (auto& th : threads)
+		th.join();
+
+	if (find(ok.begin(), ok.end(), 0) != ok.end()) {
+		for (auto w : workers)
+			delete w;
+		syntax_error(__LINE__);
+	}
+
+	for (int i = 0; i < n; i++) {
+		// token positions of lazy bodies are relative to the worker's range
+		for (auto p : workers[i]->p_table) {
+			if (p->body_begin >= 0)
+				p->body_begin += bounds[i];
+		}
+
+		p_table.insert(p_table.end(), workers[i]->p_table.begin(), workers[i]->p_table.end());
+		error_t.insert(error_t.end(), workers[i]->error_t.begin(), workers[i]->error_t.end());
+		if (workers[i]->errorno != 0)
+			errorno = workers[i]->errorno;
+		// the declarations now belong to this parser
+		workers[i]->p_table.clear();
+		delete workers[i];
+	}
+
+	lexer.SetIndex(end);
+	return true;
+}
+
+// parses all declarations in a worker's range, which must hold nothing else;
+// returns false on a syntax error
+bool Parser::parse_worker_declarations() {
+	Token t;
+
+	try {
+		do {
+			p_table.push_back(parse_poly_decl());
+			STATS_ADD(polynomials, 1);
+			t = lexer.peek(1);
+		} while (t.token_type == POLY);
+
+		if (t.token_type != END_OF_FILE)
+			syntax_error(__LINE__);
+	} catch (parse_exit&) {
+		return false;
+	}
+
+	return true;
 }
 
 // poly_decl -> POLY polynomial_header EQUAL polynomial_body SEMICOLON
 polynomial* Parser::parse_poly_decl() {
 	polynomial* p = new polynomial;
-	
 	Token t = lexer.peek(1);
-	
-	// determine if next token is POLY
-	if (t.token_type == POLY) {
-		lexer.GetToken();
-		t = lexer.peek(1);
-	} else
-		syntax_error(__LINE__);
 
-	parse_polynomial_header(p);
-	t = lexer.peek(1);
-	
-	// determine if next token is EQUAL
-	if (t.token_type == EQUAL) {
-		lexer.GetToken();
+	// a declaration that fails to parse is freed before the error goes up
+	try {
+		// determine if next token is POLY
+		if (t.token_type == POLY) {
+			lexer.GetToken();
+			t = lexer.peek(1);
+		} else
+			syntax_error(__LINE__);
+
+		parse_polynomial_header(p);
 		t = lexer.peek(1);
-	} else
-		syntax_error(__LINE__);
 
-	parse_polynomial_body(p);
-	t = lexer.peek(1);
+		// determine if next token is EQUAL
+		if (t.token_type == EQUAL) {
+			lexer.GetToken();
+			t = lexer.peek(1);
+		} else
+			syntax_error(__LINE__);
 
-	// determine if next token is SEMICOLON
-	if (t.token_type == SEMICOLON) {
-		lexer.GetToken();
+		if (lazy) {
+			scan_polynomial_body(p);
+		} else {
+			parse_polynomial_body(p);
+			normalize_polynomial(p);
+		}
 		t = lexer.peek(1);
-	} else
-		syntax_error(__LINE__);
+
+		// determine if next token is SEMICOLON
+		if (t.token_type == SEMICOLON) {
+			lexer.GetToken();
+			t = lexer.peek(1);
+		} else
+			syntax_error(__LINE__);
+	} catch (...) {
+		delete_polynomial(p);
+		throw;
+	}
 
 	return p;
 }
 
+// Checks that a body is a term_list followed by SEMICOLON, accepting exactly
+// what parse_polynomial_body() does, and records error code 2 for variables
+// that are not parameters. Nothing is built: the position of the body is
+// kept in p->body_begin for compile_polynomial_body()
+void Parser::scan_polynomial_body(polynomial* p) {
+	int i = lexer.GetIndex();
+
+	p->body_begin = i;
+
+	// term_list -> term | term add_operator term_list
+	while (true) {
+		// term -> monomial_list | coefficient monomial_list | coefficient
+		if (lexer.HasToken(i) && lexer.TokenAt(i).token_type == NUM)
+			i++;
+		else if (!lexer.HasToken(i) || lexer.TokenAt(i).token_type != ID)
+			syntax_error(__LINE__);
+
+		// monomial -> ID | ID exponent
+		while (lexer.HasToken(i) && lexer.TokenAt(i).token_type == ID) {
+			const Token& id = lexer.TokenAt(i);
+			if (p->get_param(id.lexeme) == -1) {
+				errorno = 2;
+				error_t.push_back(id.line_no);
+			}
+			i++;
+
+			// exponent -> POWER NUM
+			if (lexer.HasToken(i) && lexer.TokenAt(i).token_type == POWER) {
+				if (!lexer.HasToken(i + 1) || lexer.TokenAt(i + 1).token_type != NUM)
+					syntax_error(__LINE__);
+				i += 2;
+			}
+		}
+
+		// add_operator -> PLUS | MINUS
+		if (!lexer.HasToken(i) || (lexer.TokenAt(i).token_type != PLUS && lexer.TokenAt(i).token_type != MINUS))
+			break;
+		i++;
+	}
+
+	if (!lexer.HasToken(i) || lexer.TokenAt(i).token_type != SEMICOLON)
+		syntax_error(__LINE__);
+
+	lexer.SetIndex(i);
+}
+
+// builds a body that scan_polynomial_body() skipped; does nothing if the
+// body of p is already built
+void Parser::compile_polynomial_body(polynomial* p) {
+	if (p->body_begin < 0)
+		return;
+
+	int resume = lexer.GetIndex();
+	mem_scope scope(MEM_AST);
+
+	lexer.SetIndex(p->body_begin);
+	parse_polynomial_body(p);
+	normalize_polynomial(p);
+	lexer.SetIndex(resume);
+
+	p->body_begin = -1;
+	STATS_ADD(bodies_compiled, 1);
+}
+
 // polynomial_header -> polynomial_name | polynomial_name LPAREN id_list RPAREN
 void Parser::parse_polynomial_header(polynomial* p) {
 	Token t = lexer.peek(1);
@@ -557,35 +1190,27 @@ void Parser::parse_polynomial_body(polynomial* p) {
 }
 
 // term_list -> term | term add_operator term_list
+// (parsed iteratively so that long bodies do not exhaust the stack)
 void Parser::parse_term_list(polynomial* p) {
 	Token t = lexer.peek(1);
-	term* tr = new term;
+	term* tr;
 
 	// determine if term via: ID, NUM token(s)
-	if (t.token_type == ID || t.token_type == NUM) {
+	while (t.token_type == ID || t.token_type == NUM) {
 		tr = parse_term(p);
+		p->polynomial_body.push_back(tr);
 		t = lexer.peek(1);
 
 		// determine if add_operator via: PLUS, MINUS token(s)
-		if (t.token_type == PLUS || t.token_type == MINUS) {
-			tr->op = parse_add_operator();
-			p->polynomial_body.push_back(tr);
-			t = lexer.peek(1);
-			
-			// determine if term_list via: ID, NUM token(s)
-			if (t.token_type == ID || t.token_type == NUM) {
-				parse_term_list(p);
-				t = lexer.peek(1);
-				return;
+		if (t.token_type != PLUS && t.token_type != MINUS)
+			return;
 
-			} else {
-				syntax_error(__LINE__);
-			}
+		tr->op = parse_add_operator();
+		t = lexer.peek(1);
 
-		}
-		
-		p->polynomial_body.push_back(tr);
-		return; 
+		// determine if term_list via: ID, NUM token(s)
+		if (t.token_type != ID && t.token_type != NUM)
+			syntax_error(__LINE__);
 	}
 
 	syntax_error(__LINE__);
@@ -596,26 +1221,32 @@ term* Parser::parse_term(polynomial* p) {
 	Token t = lexer.peek(1);
 	term* tr = new term;
 
-	// determine if monomial_list via: ID token
-	if (t.token_type == ID) {
-		parse_monomial_list(tr, p);
-		tr->coefficient = 1;
-		return tr;
-
-	// determine if coefficient via: NUM token
-	} else if (t.token_type == NUM) {
-		tr->coefficient = parse_coefficient();
-		t = lexer.peek(1);
-
+	try {
 		// determine if monomial_list via: ID token
 		if (t.token_type == ID) {
 			parse_monomial_list(tr, p);
+			tr->coefficient = 1;
+			return tr;
+
+		// determine if coefficient via: NUM token
+		} else if (t.token_type == NUM) {
+			tr->coefficient = parse_coefficient();
+			t = lexer.peek(1);
+
+			// determine if monomial_list via: ID token
+			if (t.token_type == ID) {
+				parse_monomial_list(tr, p);
+			}
+
+			return tr;
 		}
 
-		return tr;
+		syntax_error(__LINE__);
+	} catch (...) {
+		delete_term(tr);
+		throw;
 	}
 
-	syntax_error(__LINE__);
 	return 0;
 }
 
@@ -643,10 +1274,10 @@ void Parser::parse_monomial_list(term* tr, polynomial* p) {
 // monomial -> ID | ID exponent 
 monomial* Parser::parse_monomial(polynomial* p) {
 	Token t = lexer.peek(1);
-	monomial* m = new monomial;
 
 	// determine if ID is next token
 	if (t.token_type == ID) {
+		monomial* m = new monomial;
 		m->var_name = p->get_param(t.lexeme);
 		if(m->var_name == -1) {
 			errorno = 2;
@@ -657,7 +1288,12 @@ monomial* Parser::parse_monomial(polynomial* p) {
 
 		// determine if exponent via: POWER token
 		if (t.token_type == POWER) {
-			m->exp = parse_exponent();
+			try {
+				m->exp = parse_exponent();
+			} catch (...) {
+				delete m;
+				throw;
+			}
 			return m;
 		} else
 			m->exp = 1;
@@ -728,6 +1364,9 @@ stmt* Parser::parse_start() {
 	stmt* head = new stmt;
 	stmt* st = head;
 
+	// freed with the parser from here on, even if the list is incomplete
+	program = head;
+
 	// determine if next token is START
 	if (t.token_type == START) {
 		lexer.GetToken();
@@ -745,45 +1384,37 @@ stmt* Parser::parse_start() {
 }
 
 // inputs -> NUM | NUM inputs
+// (parsed iteratively so that long input sections do not exhaust the stack)
 void Parser::parse_inputs() {
 	Token t = lexer.peek(1);
 
 	// determine if next token is NUM
-	if (t.token_type == NUM) {
+	if (t.token_type != NUM)
+		syntax_error(__LINE__);
+
+	// determine if inputs via: NUM token
+	while (t.token_type == NUM) {
 		i_table.add_input(stoi(t.lexeme));
 		lexer.GetToken();
 		t = lexer.peek(1);
-
-		// determine if inputs via: NUM token
-		if (t.token_type == NUM) {
-			parse_inputs();
-			return;
-		}
-	} else
-		syntax_error(__LINE__);
-
-	return;
+	}
 }
 
 // statement_list -> statement | statement statement_list
+// (parsed iteratively so that long statement lists do not exhaust the stack)
 void Parser::parse_statement_list(stmt* stm) {
 	Token t = lexer.peek(1);
 
 	// determine if statement via: INPUT, ID token(s)
-	if (t.token_type == INPUT || t.token_type == ID) {
+	if (t.token_type != INPUT && t.token_type != ID)
+		syntax_error(__LINE__);
+
+	// determine if statement_list via: INPUT, ID token(s)
+	while (t.token_type == INPUT || t.token_type == ID) {
 		stm->next = parse_statement();
+		stm = stm->next;
 		t = lexer.peek(1);
-
-		// determine if statement_list via: INPUT, ID token(s)
-		if (t.token_type == INPUT || t.token_type == ID) {
-			parse_statement_list(stm->next);
-			return;
-		}
-
-		return;
 	}
-
-	syntax_error(__LINE__);
 }
 
 // statement -> input_statement | poly_evaluation_statement
@@ -791,30 +1422,36 @@ stmt* Parser::parse_statement() {
 	stmt* st = new stmt;
 	Token t = lexer.peek(1);
 
-	// determine if input_statement via: INPUT token
-	if (t.token_type == INPUT) {
-		st->stmt_type = INPUT;
-		st->pe = NULL;
-		st->variable = parse_input_statement(); 
-		return st;
-	
-	// determine if poly_evaluation_statement via: ID token
-	} else if (t.token_type == ID) {
-		st->stmt_type = POLY;
-		poly_eval* poly_e = parse_poly_evaluation_statement(); 
-		st->pe = poly_e;
+	try {
+		// determine if input_statement via: INPUT token
+		if (t.token_type == INPUT) {
+			st->stmt_type = INPUT;
+			st->pe = NULL;
+			st->variable = parse_input_statement(); 
+			return st;
+		
+		// determine if poly_evaluation_statement via: ID token
+		} else if (t.token_type == ID) {
+			st->stmt_type = POLY;
+			poly_eval* poly_e = parse_poly_evaluation_statement(); 
+			st->pe = poly_e;
+
+			return st;
+		}
 
-		return st;
+		syntax_error(__LINE__);
+	} catch (...) {
+		delete st;
+		throw;
 	}
 
-	syntax_error(__LINE__);
 	return 0;
 }
 
 // poly_evaluation_statement -> polynomial_evaluation SEMICOLON
 poly_eval* Parser::parse_poly_evaluation_statement() {
 	Token t = lexer.peek(1);
-	poly_eval* pe = new poly_eval;
+	poly_eval* pe;
 
 	// determine if polynomial_evaluation via ID token
 	if (t.token_type == ID) {
@@ -826,6 +1463,7 @@ poly_eval* Parser::parse_poly_evaluation_statement() {
 			lexer.GetToken();
 			return pe;
 		}
+		delete_call(pe);
 	}
 
 	syntax_error(__LINE__);
@@ -866,44 +1504,50 @@ poly_eval* Parser::parse_polynomial_evaluation() {
 	poly_eval* pe = new poly_eval;
 	pe->alist = new vector<arg*>();
 
-	// determine if polynomial_name via: ID token
-	if (t.token_type == ID) {
-		pe->poly = get_polyname(parse_polynomial_name());
-		pe->lineno = t.line_no;
-
-		if ((pe->poly == -1) && (errorno == 3))
-			error_t.push_back(t.line_no);
+	try {
+		// determine if polynomial_name via: ID token
+		if (t.token_type == ID) {
+			pe->poly = get_polyname(parse_polynomial_name());
+			pe->lineno = t.line_no;
 
-		t = lexer.peek(1);
+			if ((pe->poly == -1) && (errorno == 3))
+				error_t.push_back(t.line_no);
 
-		// determine if next token is LPAREN
-		if (t.token_type == LPAREN) {
-			lexer.GetToken();
 			t = lexer.peek(1);
 
-			// determine if argument_list via: ID, NUM token(s)
-			if (t.token_type == ID || t.token_type == NUM) {
-				parse_argument_list(pe);
+			// determine if next token is LPAREN
+			if (t.token_type == LPAREN) {
+				lexer.GetToken();
+				t = lexer.peek(1);
 
-				if ((pe->poly != -1) && (pe->alist->size() != p_table[pe->poly]->param_names.size())) {
-					error_t.push_back(pe->lineno);
-					errorno = 4;
-				}
+				// determine if argument_list via: ID, NUM token(s)
+				if (t.token_type == ID || t.token_type == NUM) {
+					parse_argument_list(pe);
 
-				t = lexer.peek(1);
+					if ((pe->poly != -1) && (pe->alist->size() != p_table[pe->poly]->param_names.size())) {
+						error_t.push_back(pe->lineno);
+						errorno = 4;
+					}
 
-				// determine if next token is RPAREN
-				if (t.token_type == RPAREN) {
-					lexer.GetToken();
-					return pe;
+					t = lexer.peek(1);
+
+					// determine if next token is RPAREN
+					if (t.token_type == RPAREN) {
+						lexer.GetToken();
+						return pe;
+					}
 				}
 			}
 		}
-	}
 
-	if (errorno != 3)
-		syntax_error(__LINE__);
+		if (errorno != 3)
+			syntax_error(__LINE__);
+	} catch (...) {
+		delete_call(pe);
+		throw;
+	}
 
+	delete_call(pe);
 	return 0;
 }
 
@@ -943,45 +1587,45 @@ void Parser::parse_argument_list(poly_eval* pe) {
 arg* Parser::parse_argument(poly_eval* pe) {
 	Token t = lexer.peek(1);
 	arg* a = new arg;
-	// determine if next token is ID
-	if (t.token_type == ID) {
-		Token p = lexer.peek(2);
 
-		// determine if polynomial_evaluation via LPAREN token
-		if (p.token_type == LPAREN) {
-			a->etype = POLY;
-			a->peval = parse_polynomial_evaluation();
-			return a;
-		// case when arg is an ID
-		} else {
-			a->etype = ID;
-			//a->index = p_table[pe->poly]->get_param(t.lexeme);
-			a->index = i_table.get_var(t.lexeme);
-			if (a->index == -1) {
-				errorno = 5;
-				error_t.push_back(t.line_no);
+	try {
+		// determine if next token is ID
+		if (t.token_type == ID) {
+			Token p = lexer.peek(2);
+
+			// determine if polynomial_evaluation via LPAREN token
+			if (p.token_type == LPAREN) {
+				a->etype = POLY;
+				a->peval = parse_polynomial_evaluation();
+				return a;
+			// case when arg is an ID
+			} else {
+				a->etype = ID;
+				//a->index = p_table[pe->poly]->get_param(t.lexeme);
+				a->index = i_table.get_var(t.lexeme);
+				if (a->index == -1) {
+					errorno = 5;
+					error_t.push_back(t.line_no);
+				}
+				a->peval = 0;
+				lexer.GetToken();
+				return a;
 			}
-			a->peval = 0;
+
+		// determine if next token is NUM
+		} else if (t.token_type == NUM) {
+			a->etype = NUM;
+			a->value = stoi(t.lexeme);
 			lexer.GetToken();
 			return a;
-		}
 
-	// determine if next token is NUM
-	} else if (t.token_type == NUM) {
-		a->etype = NUM;
-		a->value = stoi(t.lexeme);
-		lexer.GetToken();
-		return a;
-
-	} else
-		syntax_error(__LINE__);
+		} else
+			syntax_error(__LINE__);
+	} catch (...) {
+		delete a;
+		throw;
+	}
 	
 	return 0;
 
 }
-
-int main() {
-	Parser parser;
-	parser.parse_input();
-	return(0);
-}
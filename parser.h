@@ -10,8 +10,33 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
+#include <map>
+#include <ostream>
 #include <string>
 #include "lexer.h"
+#include "memo.h"
+#include "results.h"
+
+//////////////////////////////////////////////////////
+// Arithmetic helpers
+//////////////////////////////////////////////////////
+
+// raises base to a non-negative power with 32-bit wrap-around arithmetic.
+// Unlike (int)pow(base, exp) this keeps x^a * x^b == x^(a+b) for every int x,
+// which is what lets the optimizer merge and combine monomials.
+inline int int_pow(int base, int exp) {
+	unsigned int result = 1;
+	unsigned int b = (unsigned int) base;
+
+	while (exp > 0) {
+		if (exp & 1)
+			result *= b;
+		b *= b;
+		exp >>= 1;
+	}
+
+	return (int) result;
+}
 
 //////////////////////////////////////////////////////
 // Data structures
@@ -21,12 +46,15 @@
 
 typedef struct input_table {
 	int next_i;
-	std::vector<std::pair<std::string, int>> var_map;
+	std::vector<std::pair<std::string, int>> var_map;	// name and current value
 	std::vector<int> input_map;
+	ValueReader* stream;	// supplies the inputs after input_map, or NULL
+	InputFile* file;		// holds the inputs after input_map, or NULL
 
 	int add_var(std::string var_name);
 	void add_input(int in);
 	int get_var(std::string str);
+	bool read_input(int i, int& value);
 	input_table();
 
 } input_table;
@@ -48,12 +76,20 @@ typedef struct term {
 
 // polynomial declaration table
 
+struct flat_body;
+struct small_body;
+struct chain_body;
+
 typedef struct polynomial {
 	std::string name;
 	int decl_lineno;
 	int param_i;
 	std::map<int, std::string> param_names;
 	std::vector<term*> polynomial_body;
+	flat_body* flat;	// dense body for the vectorized kernel, or NULL
+	small_body* small;	// compact body for a specialized kernel, or NULL
+	chain_body* chain;	// evaluation schedule sharing powers and products, or NULL
+	int body_begin;		// first token of a body not compiled yet, or -1
 	void add_param(std::string p);
 	int get_param(std::string p);
 	void get_var(std::string str);
@@ -79,19 +115,66 @@ typedef struct arg {
 	arg();
 } arg;
 
+// Thrown in place of calling exit() when a program is rejected, after the
+// error has been written to the parser's output stream, so that several
+// programs can be compiled in one process. Workers throw it without
+// writing anything; status is the exit status of a standalone run
+typedef struct parse_exit {
+	int status;
+} parse_exit;
+
+// consecutive statements that evaluate the same one-parameter polynomial at
+// constant arguments, which execute_program() evaluates all at once: by
+// forward differences at start, start + step, ..., or by multipoint
+// evaluation at points if there are any
+typedef struct poly_run {
+	int poly;
+	int count;					// statements in the run
+	unsigned int start;			// first argument
+	unsigned int step;			// difference between consecutive arguments
+	std::vector<unsigned int> points;		// every argument, for multipoint runs
+	std::vector<unsigned int> coefficients;	// dense form, see univariate.h
+} poly_run;
+
 // statement DS
 typedef struct stmt {
 	TokenType stmt_type;
 	poly_eval* pe;
 	int variable;
+	poly_run* run;	// set on the first statement of a run, or NULL
 	stmt* next;
 	stmt();
 } stmt;
 
 class Parser {
   public:
+	Parser();
+	Parser(const std::string& text);
+	Parser(const std::string& text, int jobs);
+	explicit Parser(int queue_tokens);
+	~Parser();
+	void set_output(std::ostream* os);
+	void set_jobs(int n);
+	void set_input_stream(ValueReader* reader);
+	void set_input_file(InputFile* file);
+	void set_memo(size_t capacity);
+	void set_lazy(bool on);
+	void set_result_writer(ResultWriter* writer);
+	void set_code_output(std::ostream* os);
+	void set_gradient(bool on);
+	int token_count();
+	void check_program();
+	void optimize_program(stmt* start);
+	void compile_referenced(stmt* start);
+	void compile_polynomial_body(polynomial* p);
+	void inline_compositions(stmt* start);
+	void select_kernels();
+	void find_runs(stmt* start);
 	void execute_program(stmt* start);
+	void emit_cpp(stmt* start, std::ostream& os);
 	int evaluate_polynomial(poly_eval* pe);
+	int evaluate_gradient(poly_eval* pe, std::vector<int>& partials);
+	int argument_value(arg* a);
 	void parse_input(); 
 	stmt* parse_program(); 
 	void parse_poly_decl_section(); 
@@ -120,8 +203,20 @@ class Parser {
   private:
 	int errorno;
     LexicalAnalyzer lexer;
+	std::ostream* out;
+	int jobs;
+	bool worker;
+	EvalCache* memo;
+	bool lazy;
+	ResultWriter* results;
+	std::ostream* code;
+	bool gradient;
+	Parser(const LexicalAnalyzer& source, int begin, int end);
+	bool parse_poly_decl_section_parallel();
+	bool parse_worker_declarations();
 	input_table i_table;
 	std::vector<polynomial*> p_table;
+	stmt* program;		// the statement list parse_start() built, or NULL
 	std::vector<int> error_t;
 	void checkE1();
 	void error_code_2();
@@ -130,6 +225,10 @@ class Parser {
 	void error_code_5();
     void syntax_error(int lineno);
 	int get_polyname(std::string str);
+	void normalize_polynomial(polynomial* p);
+	void scan_polynomial_body(polynomial* p);
+	int evaluate_body(polynomial* pn, const int* args);
+	void put_result(int v);
     Token expect(TokenType expected_type);
 };
 
@@ -0,0 +1,119 @@
+/*
+ * Hardware performance counters enabled with --perf
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perfcount.h"
+
+using namespace std;
+
+perf_counters perf;
+
+const char* perf_event_names[PERF_EVENT_COUNT] = {
+	"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"
+};
+
+// read misses for the generic cache events
+#define CACHE_READ_MISS(cache) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+	unsigned int type;
+	unsigned long long config;
+} event_configs[PERF_EVENT_COUNT] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+	{ PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL) },
+};
+
+perf_counters::perf_counters() {
+	enabled = false;
+	opened = 0;
+	open_errno = 0;
+}
+
+// the counters of one thread; -1 for an event that did not open
+typedef struct thread_counters {
+	int fd[PERF_EVENT_COUNT];
+
+	thread_counters() {
+		for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = event_configs[i].type;
+			attr.config = event_configs[i].config;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			// this thread, on any CPU
+			fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+			if (fd[i] >= 0) {
+				perf.opened.fetch_or(1 << i);
+			} else {
+				int expected = 0;
+				perf.open_errno.compare_exchange_strong(expected, errno);
+			}
+		}
+	}
+
+	~thread_counters() {
+		for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+			if (fd[i] >= 0)
+				close(fd[i]);
+		}
+	}
+} thread_counters;
+
+// Reads every counter of the calling thread. When there are more events
+// than hardware counters the kernel time-shares them, and a count is scaled
+// up by the fraction of the time it was actually counting
+void perf_counters::read(perf_sample& s) {
+	static thread_local thread_counters counters;
+
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		unsigned long long data[3];	// value, time enabled, time running
+
+		s.value[i] = 0;
+		if (counters.fd[i] < 0 || ::read(counters.fd[i], data, sizeof(data)) != sizeof(data))
+			continue;
+		if (data[2] > 0 && data[2] < data[1])
+			s.value[i] = (long long) ((double) data[0] * data[1] / data[2]);
+		else
+			s.value[i] = data[0];
+	}
+}
+
+bool perf_counters::available(int event) {
+	return (opened.load() >> event) & 1;
+}
+
+// prints the events that could not be counted on stderr, once all threads
+// that read counters are done
+void perf_counters::report_unavailable() {
+	if (opened.load() == (1 << PERF_EVENT_COUNT) - 1)
+		return;
+
+	fprintf(stderr, "perf: unavailable:");
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		if (!available(i))
+			fprintf(stderr, " %s", perf_event_names[i]);
+	}
+
+	int e = open_errno.load();
+	fprintf(stderr, " (%s%s)\n", strerror(e),
+			e == EACCES || e == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+}
+
+void perf_delta(const perf_sample& start, const perf_sample& end, perf_sample& delta) {
+	for (int i = 0; i < PERF_EVENT_COUNT; i++)
+		delta.value[i] = end.value[i] - start.value[i];
+}
@@ -0,0 +1,46 @@
+/*
+ * Hardware performance counters enabled with --perf
+ */
+#ifndef __PERFCOUNT_H__
+#define __PERFCOUNT_H__
+
+#include <atomic>
+#include <string>
+
+typedef enum { PERF_CYCLES = 0, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_EVENT_COUNT
+    } PerfEvent;
+
+// counter values at one point of a thread's execution
+typedef struct perf_sample {
+	long long value[PERF_EVENT_COUNT];
+} perf_sample;
+
+// Counts events in user space with perf_event_open(2), separately for every
+// thread that reads them; a thread's counters are opened the first time it
+// reads them and closed when it ends. Events the kernel or the hardware
+// does not provide (e.g. with perf_event_paranoid above 2, or in a virtual
+// machine) read as 0 and are reported as unavailable.
+class perf_counters {
+  public:
+	bool enabled;
+
+	void read(perf_sample& s);
+	bool available(int event);
+	void report_unavailable();
+	perf_counters();
+
+  private:
+	std::atomic<int> opened;		// bit i: event i opened in some thread
+	std::atomic<int> open_errno;	// why an event did not open, or 0
+	friend struct thread_counters;
+};
+
+extern perf_counters perf;
+
+extern const char* perf_event_names[PERF_EVENT_COUNT];
+
+// end - start, event by event
+void perf_delta(const perf_sample& start, const perf_sample& end, perf_sample& delta);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Per-polynomial evaluation profiler enabled with --profile
+ */
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+#include "parser.h"
+#include "profiler.h"
+
+using namespace std;
+
+eval_profiler profiler;
+
+call_node::call_node() {
+	poly = NULL;
+	lineno = 0;
+	depth = 0;
+	parent = NULL;
+	calls = 0;
+	inclusive_ns = 0;
+	exclusive_ns = 0;
+	exclusive_events = perf_sample();
+}
+
+eval_profiler::eval_profiler() {
+	enabled = false;
+	current = &root;
+}
+
+void eval_profiler::enter(const polynomial* poly, int lineno) {
+	call_node*& child = current->children[make_pair(poly, lineno)];
+
+	if (child == NULL) {
+		child = new call_node;
+		child->poly = poly;
+		child->lineno = lineno;
+		child->depth = current->depth + 1;
+		child->parent = current;
+	}
+
+	current = child;
+	frame f = { child, clock::now(), 0, perf_sample(), perf_sample() };
+	if (perf.enabled)
+		perf.read(f.start_events);
+	stack.push_back(f);
+}
+
+void eval_profiler::leave() {
+	frame f = stack.back();
+	stack.pop_back();
+
+	double ns = chrono::duration<double, nano>(clock::now() - f.start).count();
+	f.node->calls += 1;
+	f.node->inclusive_ns += ns;
+	f.node->exclusive_ns += ns - f.children_ns;
+
+	if (!stack.empty())
+		stack.back().children_ns += ns;
+	current = f.node->parent;
+
+	if (perf.enabled) {
+		perf_sample end;
+		perf_sample delta;
+		perf.read(end);
+		perf_delta(f.start_events, end, delta);
+		for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+			f.node->exclusive_events.value[i] += delta.value[i] - f.children_events.value[i];
+			if (!stack.empty())
+				stack.back().children_events.value[i] += delta.value[i];
+		}
+	}
+}
+
+static string frame_name(const call_node* node) {
+	return node->poly->name + ":" + to_string(node->lineno);
+}
+
+// writes one line per call chain in the collapsed-stack format read by
+// flamegraph tools: "F:3;X:3 <exclusive nanoseconds>"
+static void write_stacks(ofstream& out, const call_node* node, const string& prefix) {
+	for (auto& it : node->children) {
+		const call_node* child = it.second;
+		string path = prefix.empty() ? frame_name(child) : prefix + ";" + frame_name(child);
+
+		out << path << " " << (long) child->exclusive_ns << "\n";
+		write_stacks(out, child, path);
+	}
+}
+
+bool eval_profiler::write(const string& path) {
+	ofstream out(path.c_str());
+
+	if (!out)
+		return false;
+
+	write_stacks(out, &root, "");
+	return (bool) out;
+}
+
+typedef struct profile_entry {
+	long calls;
+	double inclusive_ns;
+	double exclusive_ns;
+	perf_sample exclusive_events;
+	int max_depth;
+} profile_entry;
+
+// Folds the call tree into totals per key. A call nested inside a call with
+// the same key (e.g. F(F(2))) is already part of the outer call's inclusive
+// time, so only the outermost one adds to it.
+template <typename Key, typename KeyOf>
+static void aggregate(const call_node* node, map<Key, profile_entry>& totals,
+		multiset<Key>& active, KeyOf key_of) {
+	for (auto& it : node->children) {
+		const call_node* child = it.second;
+		Key key = key_of(child);
+		profile_entry& e = totals[key];
+
+		e.calls += child->calls;
+		e.exclusive_ns += child->exclusive_ns;
+		for (int i = 0; i < PERF_EVENT_COUNT; i++)
+			e.exclusive_events.value[i] += child->exclusive_events.value[i];
+		if (active.count(key) == 0)
+			e.inclusive_ns += child->inclusive_ns;
+		e.max_depth = max(e.max_depth, child->depth);
+
+		auto pos = active.insert(key);
+		aggregate(child, totals, active, key_of);
+		active.erase(pos);
+	}
+}
+
+template <typename Key>
+static void print_totals(const char* kind, map<Key, profile_entry>& totals,
+		string (*name_of)(const Key&)) {
+	vector<pair<Key, profile_entry>> sorted(totals.begin(), totals.end());
+
+	sort(sorted.begin(), sorted.end(),
+			[](const pair<Key, profile_entry>& a, const pair<Key, profile_entry>& b) {
+				return a.second.exclusive_ns > b.second.exclusive_ns;
+			});
+
+	for (auto& it : sorted) {
+		fprintf(stderr, "profile: %s=%s calls=%ld inclusive_ms=%.3f exclusive_ms=%.3f max_depth=%d",
+				kind, name_of(it.first).c_str(), it.second.calls,
+				it.second.inclusive_ns / 1e6, it.second.exclusive_ns / 1e6, it.second.max_depth);
+
+		// exclusive counts of the events that could be counted
+		if (perf.enabled) {
+			for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+				if (perf.available(i))
+					fprintf(stderr, " %s=%lld", perf_event_names[i], it.second.exclusive_events.value[i]);
+			}
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+static string poly_key_name(const polynomial* const& p) {
+	return p->name;
+}
+
+static string site_key_name(const pair<const polynomial*, int>& site) {
+	return site.first->name + ":" + to_string(site.second);
+}
+
+// prints totals per polynomial and per call site on stderr, most
+// expensive (by exclusive time) first
+void eval_profiler::summary() {
+	map<const polynomial*, profile_entry> polys;
+	map<pair<const polynomial*, int>, profile_entry> sites;
+	multiset<const polynomial*> active_polys;
+	multiset<pair<const polynomial*, int>> active_sites;
+
+	aggregate(&root, polys, active_polys,
+			[](const call_node* n) { return n->poly; });
+	aggregate(&root, sites, active_sites,
+			[](const call_node* n) { return make_pair(n->poly, n->lineno); });
+
+	print_totals("polynomial", polys, poly_key_name);
+	print_totals("site", sites, site_key_name);
+}
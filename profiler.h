@@ -0,0 +1,64 @@
+/*
+ * Per-polynomial evaluation profiler enabled with --profile
+ */
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "perfcount.h"
+
+struct polynomial;
+
+// one node per distinct chain of nested calls; a call is identified by the
+// polynomial and the line of the call site (poly_eval::lineno)
+typedef struct call_node {
+	const polynomial* poly;
+	int lineno;
+	int depth;
+	call_node* parent;
+	std::map<std::pair<const polynomial*, int>, call_node*> children;
+
+	long calls;
+	double inclusive_ns;
+	double exclusive_ns;
+	perf_sample exclusive_events;	// with --perf
+
+	call_node();
+} call_node;
+
+class eval_profiler {
+  public:
+	bool enabled;
+
+	void enter(const polynomial* poly, int lineno);
+	void leave();
+	bool write(const std::string& path);
+	void summary();
+	eval_profiler();
+
+  private:
+	typedef std::chrono::steady_clock clock;
+
+	// an active call: its node, its start time and the time its children
+	// took, and the same for hardware events with --perf
+	struct frame {
+		call_node* node;
+		clock::time_point start;
+		double children_ns;
+		perf_sample start_events;
+		perf_sample children_events;
+	};
+
+	call_node root;
+	call_node* current;
+	std::vector<frame> stack;
+};
+
+extern eval_profiler profiler;
+
+#endif
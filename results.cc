@@ -0,0 +1,149 @@
+/*
+ * Binary output of evaluation results
+ */
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memacct.h"
+#include "results.h"
+
+using namespace std;
+
+// size of the block written with write() when the output is not mapped
+#define BLOCK_SIZE (1 << 16)
+
+static inline void store_le32(char* p, unsigned int v) {
+	p[0] = (char) v;
+	p[1] = (char) (v >> 8);
+	p[2] = (char) (v >> 16);
+	p[3] = (char) (v >> 24);
+}
+
+ResultWriter::ResultWriter() {
+	fd = -1;
+	header = false;
+	mapped = false;
+	data = NULL;
+	size = 0;
+	pos = 0;
+	failed = false;
+}
+
+ResultWriter::~ResultWriter() {
+	Finish();
+}
+
+// Opens path for writing, "-" meaning standard output; returns false if it
+// cannot be opened. Standard output is always written with write(): the
+// shell may have opened it write-only or for appending, and sizing or
+// mapping it would fail or overwrite what is already there
+bool ResultWriter::Open(const string& path, bool header) {
+	this->header = header;
+	mapped = false;
+	if (path == "-") {
+		fd = 1;
+		return true;
+	}
+
+	fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+	struct stat st;
+	mapped = fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+	return fd >= 0;
+}
+
+// called once the evaluation statements are known, before the first Put()
+void ResultWriter::Begin(const vector<int>& linenos) {
+	size_t n = linenos.size();
+	size_t bytes = 4 * n + (header ? 16 + 4 * n : 0);
+
+	if (mapped) {
+		// an empty mapping is not allowed; nothing to write then
+		if (bytes == 0 || ftruncate(fd, bytes) != 0) {
+			failed = (bytes != 0);
+			return;
+		}
+		void* m = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (m == MAP_FAILED) {
+			failed = true;
+			return;
+		}
+		data = (char*) m;
+		size = bytes;
+	} else {
+		mem_scope scope(MEM_OUTPUT);
+		data = new char[BLOCK_SIZE];
+		size = BLOCK_SIZE;
+	}
+
+	if (!header)
+		return;
+
+	Reserve(16);
+	memcpy(data + pos, "POLR", 4);
+	store_le32(data + pos + 4, 1);
+	store_le32(data + pos + 8, n);
+	store_le32(data + pos + 12, 0);
+	pos += 16;
+
+	for (auto lineno : linenos) {
+		Reserve(4);
+		store_le32(data + pos, lineno);
+		pos += 4;
+	}
+}
+
+void ResultWriter::Put(int value) {
+	Reserve(4);
+	if (data != NULL) {
+		store_le32(data + pos, (unsigned int) value);
+		pos += 4;
+	}
+}
+
+// makes room for bytes more bytes, writing out the block if it is full
+void ResultWriter::Reserve(size_t bytes) {
+	if (!mapped && pos + bytes > size)
+		Flush();
+}
+
+void ResultWriter::Flush() {
+	size_t done = 0;
+
+	while (done < pos && !failed) {
+		ssize_t n = write(fd, data + done, pos - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			failed = true;
+		else
+			done += n;
+	}
+
+	pos = 0;
+}
+
+// writes out or unmaps what is left and closes the output; returns false
+// if anything could not be written
+bool ResultWriter::Finish() {
+	if (fd < 0)
+		return !failed;
+
+	if (mapped) {
+		if (data != NULL)
+			munmap(data, size);
+	} else {
+		Flush();
+		delete[] data;
+	}
+
+	if (fd != 1 && close(fd) != 0)
+		failed = true;
+
+	fd = -1;
+	data = NULL;
+	return !failed;
+}
@@ -0,0 +1,42 @@
+/*
+ * Binary output of evaluation results
+ */
+#ifndef __RESULTS_H__
+#define __RESULTS_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Writes results as 32-bit little-endian two's complement integers, one
+// per evaluation statement in execution order. The optional header is
+//
+//     "POLR"  version (1)  count  0      four 32-bit words
+//     line numbers of the count evaluation statements
+//
+// with every word little-endian. A regular file named on the command line
+// is sized up front and filled through a shared mapping; standard output
+// and anything else (a pipe, say) is written with write() in large blocks.
+class ResultWriter {
+  public:
+    bool Open(const std::string& path, bool header);
+    void Begin(const std::vector<int>& linenos);
+    void Put(int value);
+    bool Finish();
+    ResultWriter();
+    ~ResultWriter();
+
+  private:
+    int fd;
+    bool header;
+    bool mapped;
+    char* data;         // the mapping, or the block written with write()
+    size_t size;        // bytes in data
+    size_t pos;         // next byte to fill in data
+    bool failed;
+
+    void Reserve(size_t bytes);
+    void Flush();
+};
+
+#endif  //__RESULTS_H__
@@ -0,0 +1,99 @@
+/*
+ * Per-phase timers and counters reported by --stats
+ */
+#include <cstdio>
+
+#include "memacct.h"
+#include "stats.h"
+
+using namespace std;
+
+run_stats stats;
+
+static const char* phase_names[PHASE_COUNT] = {
+	"lex", "parse", "check", "optimize", "execute"
+};
+
+run_stats::run_stats() {
+	enabled = false;
+	json = false;
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		phase_ns[i] = 0;
+		for (int j = 0; j < PERF_EVENT_COUNT; j++)
+			phase_events[i][j] = 0;
+	}
+	bytes_read = 0;
+	tokens = 0;
+	ast_nodes = 0;
+	polynomials = 0;
+	bodies_compiled = 0;
+	evaluations = 0;
+	monomials = 0;
+	run_points = 0;
+	memo_hits = 0;
+	memo_misses = 0;
+	memo_evictions = 0;
+}
+
+// prints every timer and counter, and with --perf the events of every phase
+// (e.g. execute_cycles), to stderr on a single line, either as key=value
+// pairs or as a JSON object
+void run_stats::report() {
+	const char* fmt_ms = json ? "\"%s_ms\": %.3f, " : "%s_ms=%.3f ";
+	const char* fmt_count = json ? "\"%s\": %ld%s" : "%s=%ld%s";
+	const char* fmt_event = json ? "\"%s_%s\": %lld, " : "%s_%s=%lld ";
+
+	fprintf(stderr, json ? "{" : "stats: ");
+	for (int i = 0; i < PHASE_COUNT; i++)
+		fprintf(stderr, fmt_ms, phase_names[i], phase_ns[i].load() / 1e6);
+
+	// events that could not be counted are left out
+	if (perf.enabled) {
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			for (int j = 0; j < PERF_EVENT_COUNT; j++) {
+				if (perf.available(j))
+					fprintf(stderr, fmt_event, phase_names[i], perf_event_names[j], phase_events[i][j].load());
+			}
+		}
+	}
+
+	fprintf(stderr, fmt_count, "bytes_read", bytes_read.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "tokens", tokens.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "ast_nodes", ast_nodes.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "polynomials", polynomials.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "bodies_compiled", bodies_compiled.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "evaluations", evaluations.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "monomials", monomials.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "run_points", run_points.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "memo_hits", memo_hits.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "memo_misses", memo_misses.load(), json ? ", " : " ");
+	fprintf(stderr, fmt_count, "memo_evictions", memo_evictions.load(), json ? "}\n" : "\n");
+
+	if (perf.enabled)
+		perf.report_unavailable();
+}
+
+phase_timer::phase_timer(Phase p) {
+	phase = p;
+	if (stats.enabled)
+		start = chrono::steady_clock::now();
+	if (perf.enabled)
+		perf.read(events);
+}
+
+phase_timer::~phase_timer() {
+	if (perf.enabled) {
+		perf_sample end;
+		perf_sample delta;
+		perf.read(end);
+		perf_delta(events, end, delta);
+		for (int i = 0; i < PERF_EVENT_COUNT; i++)
+			stats.phase_events[phase][i].fetch_add(delta.value[i], memory_order_relaxed);
+	}
+	if (stats.enabled) {
+		chrono::nanoseconds d = chrono::steady_clock::now() - start;
+		stats.phase_ns[phase].fetch_add(d.count(), memory_order_relaxed);
+	}
+	if (memacct.enabled)
+		memacct.report(phase_names[phase]);
+}
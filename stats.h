@@ -0,0 +1,62 @@
+/*
+ * Per-phase timers and counters reported by --stats
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <atomic>
+#include <chrono>
+
+#include "perfcount.h"
+
+typedef enum { PHASE_LEX = 0, PHASE_PARSE, PHASE_CHECK,
+    PHASE_OPTIMIZE, PHASE_EXECUTE, PHASE_COUNT
+    } Phase;
+
+typedef struct run_stats {
+	bool enabled;
+	bool json;
+
+	// summed over threads when a batch compiles several programs at once
+	std::atomic<long> phase_ns[PHASE_COUNT];
+	std::atomic<long long> phase_events[PHASE_COUNT][PERF_EVENT_COUNT];	// with --perf
+
+	// counters are atomic because declarations may be parsed on several threads
+	std::atomic<long> bytes_read;
+	std::atomic<long> tokens;
+	std::atomic<long> ast_nodes;
+	std::atomic<long> polynomials;
+	std::atomic<long> bodies_compiled;	// bodies built on first use with --lazy
+	std::atomic<long> evaluations;	// every evaluate_polynomial call, nested ones included
+	std::atomic<long> monomials;	// monomial factors multiplied during evaluation
+	std::atomic<long> run_points;	// results computed for runs of statements at once
+	std::atomic<long> memo_hits;	// evaluations answered by the --memo cache
+	std::atomic<long> memo_misses;
+	std::atomic<long> memo_evictions;
+
+	run_stats();
+	void report();
+} run_stats;
+
+extern run_stats stats;
+
+// counters cost a single predictable branch when --stats is off
+#define STATS_ADD(counter, n) do { \
+	if (stats.enabled) stats.counter.fetch_add((n), std::memory_order_relaxed); \
+	} while (0)
+
+// adds the lifetime of the enclosing scope to the time of a phase, and its
+// events to the phase's counters with --perf; reports memory use at its
+// end with --memory
+class phase_timer {
+  public:
+	phase_timer(Phase p);
+	~phase_timer();
+
+  private:
+	Phase phase;
+	std::chrono::steady_clock::time_point start;
+	perf_sample events;
+};
+
+#endif
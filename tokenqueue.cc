@@ -0,0 +1,58 @@
+/*
+ * Bounded queue that hands tokens from a scanner thread to a parser thread
+ */
+#include <thread>
+#include <utility>
+
+#include "tokenqueue.h"
+
+using namespace std;
+
+// capacity is rounded up to a power of two
+TokenQueue::TokenQueue(size_t capacity)
+{
+    size_t n = 2;
+    while (n < capacity)
+        n *= 2;
+
+    slots.resize(n);
+    mask = n - 1;
+    head = 0;
+    tail = 0;
+    cancelled = false;
+}
+
+// moves token into the queue, waiting while it is full; returns false
+// without queueing it if the consumer has cancelled
+bool TokenQueue::Push(Token& token)
+{
+    size_t t = tail.load(memory_order_relaxed);
+
+    while (t - head.load(memory_order_acquire) == slots.size()) {
+        if (cancelled.load(memory_order_relaxed))
+            return false;
+        this_thread::yield();
+    }
+
+    slots[t & mask] = std::move(token);
+    tail.store(t + 1, memory_order_release);
+    return true;
+}
+
+// moves the oldest token out of the queue, waiting while it is empty
+void TokenQueue::Pop(Token& token)
+{
+    size_t h = head.load(memory_order_relaxed);
+
+    while (tail.load(memory_order_acquire) == h)
+        this_thread::yield();
+
+    token = std::move(slots[h & mask]);
+    head.store(h + 1, memory_order_release);
+}
+
+// tells the producer that nothing more will be popped
+void TokenQueue::Cancel()
+{
+    cancelled.store(true, memory_order_relaxed);
+}
@@ -0,0 +1,34 @@
+/*
+ * Bounded queue that hands tokens from a scanner thread to a parser thread
+ */
+#ifndef __TOKEN_QUEUE__H__
+#define __TOKEN_QUEUE__H__
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "lexer.h"
+
+// A ring of slots shared by exactly one producer, which calls Push(), and
+// one consumer, which calls Pop() and Cancel(). Each index is written by one
+// side only, so neither side takes a lock; a side that has to wait for the
+// other yields its time slice.
+class TokenQueue {
+  public:
+    bool Push(Token& token);
+    void Pop(Token& token);
+    void Cancel();
+    TokenQueue(size_t capacity);
+
+  private:
+    std::vector<Token> slots;
+    size_t mask;
+
+    // kept on separate cache lines so the two sides do not contend
+    alignas(64) std::atomic<size_t> head;   // next slot to pop
+    alignas(64) std::atomic<size_t> tail;   // next slot to push
+    std::atomic<bool> cancelled;
+};
+
+#endif  //__TOKEN_QUEUE__H__
@@ -0,0 +1,39 @@
+#!/bin/bash
+#
+# Generates synthetic programs of increasing size and runs the in-process
+# benchmark (a.out --bench) on each of them. Run from the repository root.
+#
+# usage: tools/bench.sh [repeats]
+
+repeats=${1:-5}
+work=./bench_work
+
+if [ ! -e "./a.out" ]; then
+    echo "Error: a.out not found!"
+    exit 1
+fi
+
+mkdir -p ${work}
+g++ -O2 -o ${work}/gen_program tools/gen_program.cc || exit 1
+
+# name and generator options of every workload
+workloads=(
+    "small      --polys=10    --terms=4   --arity=2 --max-exp=3  --depth=1 --statements=100     --inputs=100"
+    "decls      --polys=20000 --terms=10  --arity=3 --max-exp=4  --depth=0 --statements=1000    --inputs=1000"
+    "wide       --polys=20    --terms=500 --arity=4 --max-exp=6  --depth=0 --statements=10000   --inputs=10000"
+    "nested     --polys=50    --terms=6   --arity=2 --max-exp=3  --depth=4 --statements=20000   --inputs=20000"
+    "statements --polys=100   --terms=6   --arity=3 --max-exp=4  --depth=1 --statements=500000  --inputs=500000"
+    "inputs     --polys=10    --terms=4   --arity=1 --max-exp=5  --depth=0 --statements=10000   --inputs=2000000"
+)
+
+for w in "${workloads[@]}"; do
+    set -- ${w}
+    name=$1
+    shift
+    ${work}/gen_program "$@" > ${work}/${name}.txt
+    echo "== ${name}: $*"
+    ./a.out --bench=${repeats} < ${work}/${name}.txt
+    echo
+done | tee ./bench_output.txt
+
+rm -rf ${work}
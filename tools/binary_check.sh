@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Checks --binary=- against the decimal output of every provided_tests/No_Error
+# program, with standard output redirected to a new file (>) and appended to
+# an existing one (>>). Run from the repository root.
+#
+# usage: tools/binary_check.sh
+
+work=./binary_work
+
+if [ ! -x "./a.out" ]; then
+    echo "Error: a.out not found!"
+    exit 1
+fi
+
+mkdir -p ${work}
+
+# 32-bit little-endian words as one decimal per line
+words() {
+    od -An -v -w4 -t d4 --endian=little "$1" | tr -d ' '
+}
+
+let count=0
+let all=0
+
+for test_file in $(find ./provided_tests/No_Error -type f -name "*.txt" | sort); do
+    all=$((all+1))
+    name=`basename ${test_file} .txt`
+    ./a.out < ${test_file} > ${work}/expected.txt
+
+    ./a.out --binary=- < ${test_file} > ${work}/new.bin
+    status=$?
+    printf 'keep' > ${work}/append.bin
+    ./a.out --binary=- < ${test_file} >> ${work}/append.bin
+    status=$((status + $?))
+
+    # the appended results follow the four bytes that were already there
+    words ${work}/new.bin > ${work}/new.txt
+    head -c 4 ${work}/append.bin > ${work}/kept.txt
+    tail -c +5 ${work}/append.bin > ${work}/appended.bin
+    words ${work}/appended.bin > ${work}/appended.txt
+
+    if [ ${status} -ne 0 ]; then
+        echo "${name}: --binary=- failed"
+    elif ! cmp -s ${work}/expected.txt ${work}/new.txt; then
+        echo "${name}: redirected results do not match"
+    elif [ "$(cat ${work}/kept.txt)" != "keep" ] || ! cmp -s ${work}/expected.txt ${work}/appended.txt; then
+        echo "${name}: appended results do not match"
+    else
+        count=$((count+1))
+    fi
+done
+
+rm -rf ${work}
+
+echo "Passed $count tests out of $all"
+[ ${count} -eq ${all} ]
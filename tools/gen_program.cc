@@ -0,0 +1,149 @@
+/*
+ * Generates synthetic, error-free PEPL programs for benchmarking.
+ *
+ * build: g++ -O2 -o gen_program tools/gen_program.cc
+ * usage: gen_program [--polys=N] [--terms=N] [--arity=N] [--max-exp=N]
+ *                    [--depth=N] [--statements=N] [--inputs=N] [--seed=N]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+// xorshift64, so a seed produces the same program on every platform
+static unsigned int next_rand(unsigned int bound) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (unsigned int) (rng_state % bound);
+}
+
+struct gen_options {
+	int polys;
+	int terms;
+	int arity;
+	int max_exp;
+	int depth;
+	int statements;
+	int inputs;
+};
+
+static string param_name(int arity, int i) {
+	if (arity == 1)
+		return "x";
+	return "v" + to_string(i);
+}
+
+static void gen_decl(const gen_options& o, int index) {
+	if (o.arity == 1) {
+		printf("POLY P%d = ", index);
+	} else {
+		printf("POLY P%d(", index);
+		for (int i = 0; i < o.arity; i++)
+			printf("%s%s", i > 0 ? ", " : "", param_name(o.arity, i).c_str());
+		printf(") = ");
+	}
+
+	for (int t = 0; t < o.terms; t++) {
+		if (t > 0)
+			printf(next_rand(3) == 0 ? " - " : " + ");
+
+		int monomials = next_rand(o.arity < 3 ? o.arity + 1 : 4);
+		if (monomials == 0 || next_rand(2) == 0)
+			printf("%u", 1 + next_rand(9));
+
+		for (int m = 0; m < monomials; m++) {
+			int exp = next_rand(o.max_exp + 1);
+			printf(" %s", param_name(o.arity, next_rand(o.arity)).c_str());
+			if (exp != 1)
+				printf("^%d", exp);
+		}
+	}
+
+	printf(";\n");
+}
+
+static void gen_call(const gen_options& o, int depth, int vars) {
+	printf("P%u(", next_rand(o.polys));
+
+	for (int i = 0; i < o.arity; i++) {
+		if (i > 0)
+			printf(", ");
+
+		unsigned int kind = next_rand(3);
+		if (depth > 0 && kind == 0)
+			gen_call(o, depth - 1, vars);
+		else if (kind == 1)
+			printf("X%u", next_rand(vars));
+		else
+			printf("%u", next_rand(10));
+	}
+
+	printf(")");
+}
+
+static bool read_opt(const char* arg, const char* name, int* value) {
+	size_t len = strlen(name);
+	if (strncmp(arg, name, len) != 0 || arg[len] != '=')
+		return false;
+	*value = atoi(arg + len + 1);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	gen_options o = { 100, 8, 3, 4, 1, 1000, 0 };
+	int seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!read_opt(argv[i], "--polys", &o.polys) &&
+				!read_opt(argv[i], "--terms", &o.terms) &&
+				!read_opt(argv[i], "--arity", &o.arity) &&
+				!read_opt(argv[i], "--max-exp", &o.max_exp) &&
+				!read_opt(argv[i], "--depth", &o.depth) &&
+				!read_opt(argv[i], "--statements", &o.statements) &&
+				!read_opt(argv[i], "--inputs", &o.inputs) &&
+				!read_opt(argv[i], "--seed", &seed)) {
+			fprintf(stderr, "gen_program: unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (o.polys < 1 || o.terms < 1 || o.arity < 1 || o.max_exp < 0 ||
+			o.depth < 0 || o.statements < 1 || o.inputs < 0) {
+		fprintf(stderr, "gen_program: invalid option value\n");
+		return 1;
+	}
+
+	rng_state += (unsigned long long) seed * 0x9E3779B97F4A7C15ULL;
+
+	for (int i = 0; i < o.polys; i++)
+		gen_decl(o, i);
+
+	// every input variable is read once up front so all IDs are initialized
+	int vars = 4;
+	int input_stmts = 0;
+
+	printf("START\n");
+	for (int i = 0; i < vars; i++, input_stmts++)
+		printf("INPUT X%d;\n", i);
+
+	for (int s = 0; s < o.statements; s++) {
+		if (next_rand(4) == 0) {
+			printf("INPUT X%u;\n", next_rand(vars));
+			input_stmts++;
+		} else {
+			gen_call(o, o.depth, vars);
+			printf(";\n");
+		}
+	}
+
+	int inputs = o.inputs > input_stmts ? o.inputs : input_stmts;
+	for (int i = 0; i < inputs; i++)
+		printf("%u%c", next_rand(100), (i % 20 == 19 || i == inputs - 1) ? '\n' : ' ');
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+#!/bin/bash
+#
+# Performance regression check. Times every provided_tests category and a set
+# of generated programs, writes the results to perf_results.json and compares
+# them against tools/perf_baseline.json. Run from the repository root.
+#
+# usage: tools/perf_check.sh [--runs=N] [--threshold=F] [--update]
+#
+#   --runs=N       repetitions per case (default 5)
+#   --threshold=F  allowed relative slowdown or RSS growth (default 0.25)
+#   --update       overwrite the baseline with the new results
+#
+# The baseline holds timings of one machine. Regenerate it there with
+#
+#   g++ -O2 -o a.out *.cc && tools/perf_check.sh --update
+#
+# and commit tools/perf_baseline.json whenever a change is meant to move the
+# numbers, or before comparing on another machine.
+
+runs=5
+threshold=0.25
+update=0
+baseline=./tools/perf_baseline.json
+results=./perf_results.json
+work=./perf_work
+
+# absolute slack so that millisecond-sized cases do not fail on noise
+slack_ms=5
+slack_kb=1024
+
+for opt in "$@"; do
+    case ${opt} in
+        --runs=*)      runs=${opt#--runs=} ;;
+        --threshold=*) threshold=${opt#--threshold=} ;;
+        --update)      update=1 ;;
+        *) echo "usage: $0 [--runs=N] [--threshold=F] [--update]"; exit 1 ;;
+    esac
+done
+
+if [ ! -x "./a.out" ]; then
+    echo "Error: a.out not found!"
+    exit 1
+fi
+
+mkdir -p ${work}
+g++ -O2 -o ${work}/perf_run tools/perf_run.cc || exit 1
+g++ -O2 -o ${work}/gen_program tools/gen_program.cc || exit 1
+
+# generated cases: name and generator options (fixed seeds keep them stable)
+generated=(
+    "gen_decls      --polys=5000 --terms=10  --arity=3 --max-exp=4 --depth=0 --statements=500    --seed=1"
+    "gen_wide       --polys=10   --terms=400 --arity=4 --max-exp=6 --depth=0 --statements=2000   --seed=2"
+    "gen_nested     --polys=30   --terms=6   --arity=2 --max-exp=3 --depth=4 --statements=5000   --seed=3"
+    "gen_statements --polys=50   --terms=6   --arity=3 --max-exp=4 --depth=1 --statements=100000 --seed=4"
+    "gen_inputs     --polys=10   --terms=4   --arity=1 --max-exp=5 --depth=0 --statements=2000   --inputs=500000 --seed=5"
+)
+
+measure() {
+    local name=$1
+    shift
+    local line
+    line=$(${work}/perf_run --runs=${runs} "$@" -- ./a.out) || { echo "Error: ${name} failed" >&2; return 1; }
+    echo "${name} ${line}"
+}
+
+# stops at the first case that fails, leaving the cleanup to the caller
+measure_all() {
+    for dir in Error_Code_1 Error_Code_2 Error_Code_3 Error_Code_4 Error_Code_5 No_Error Syntax_Error; do
+        measure ${dir} ./provided_tests/${dir}/*.txt || return 1
+    done
+    for g in "${generated[@]}"; do
+        set -- ${g}
+        local name=$1
+        shift
+        ${work}/gen_program "$@" > ${work}/${name}.txt || { echo "Error: cannot generate ${name}" >&2; return 1; }
+        measure ${name} ${work}/${name}.txt || return 1
+    done
+}
+
+measure_all > ${work}/raw.txt || { cat ${work}/raw.txt; rm -rf ${work}; exit 1; }
+
+# raw lines look like: name runs=N min_ms=A median_ms=B peak_rss_kb=C
+awk -v threshold=${threshold} '
+    BEGIN { printf "{\n  \"threshold\": %s,\n  \"cases\": [\n", threshold }
+    {
+        for (i = 2; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+        printf "%s    {\"name\": \"%s\", \"runs\": %d, \"min_ms\": %s, \"median_ms\": %s, \"peak_rss_kb\": %d}",
+            (NR > 1 ? ",\n" : ""), $1, v["runs"], v["min_ms"], v["median_ms"], v["peak_rss_kb"]
+    }
+    END { printf "\n  ]\n}\n" }
+' ${work}/raw.txt > ${results}
+rm -rf ${work}
+
+if [ ${update} -eq 1 ]; then
+    cp ${results} ${baseline}
+    echo "Baseline updated: ${baseline}"
+    exit 0
+fi
+
+if [ ! -e ${baseline} ]; then
+    echo "Error: no baseline at ${baseline}, run with --update to create one"
+    exit 1
+fi
+
+# every case is on its own line in both files, so fields can be picked by key
+awk -v threshold=${threshold} -v slack_ms=${slack_ms} -v slack_kb=${slack_kb} '
+    function field(line, key,    m) {
+        if (match(line, "\"" key "\": [^,}]*") == 0) return ""
+        m = substr(line, RSTART, RLENGTH)
+        sub(/^[^:]*: */, "", m)
+        gsub(/"/, "", m)
+        return m
+    }
+    FNR == NR { if (index($0, "\"name\"")) base[field($0, "name")] = $0; next }
+    index($0, "\"name\"") {
+        name = field($0, "name")
+        if (!(name in base)) { printf "%-16s NEW\n", name; next }
+        # the minimum is compared because it is the least sensitive to noise
+        t = field($0, "min_ms") + 0; bt = field(base[name], "min_ms") + 0
+        r = field($0, "peak_rss_kb") + 0; br = field(base[name], "peak_rss_kb") + 0
+        status = "OK"
+        if (t > bt * (1 + threshold) + slack_ms) { status = "SLOWER"; failed++ }
+        if (r > br * (1 + threshold) + slack_kb) { status = status == "OK" ? "MORE MEMORY" : status ", MORE MEMORY"; failed++ }
+        printf "%-16s min %10.3f ms (baseline %10.3f)  peak %8d kB (baseline %8d)  %s\n", name, t, bt, r, br, status
+    }
+    END {
+        if (failed) { printf "\nPerformance regression beyond %.0f%%\n", threshold * 100; exit 1 }
+        printf "\nNo performance regressions\n"
+    }
+' ${baseline} ${results}
@@ -0,0 +1,103 @@
+/*
+ * Runs a command once per input file, several times over, and reports the
+ * wall time of each round and the peak resident set size of any process.
+ *
+ * build: g++ -O2 -o perf_run tools/perf_run.cc
+ * usage: perf_run [--runs=N] file... -- command [args...]
+ *
+ * Every file is fed to the command on standard input; its output is discarded.
+ * Prints: runs=N min_ms=... median_ms=... peak_rss_kb=...
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+static double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// runs command with file on stdin; returns false if it could not be run
+// or was killed by a signal, since its timing would then be meaningless
+static bool run_once(const char* file, char** command, long* peak_rss_kb) {
+	pid_t pid = fork();
+
+	if (pid < 0)
+		return false;
+
+	if (pid == 0) {
+		int in = open(file, O_RDONLY);
+		int out = open("/dev/null", O_WRONLY);
+		if (in < 0 || out < 0)
+			_exit(127);
+		dup2(in, 0);
+		dup2(out, 1);
+		execvp(command[0], command);
+		_exit(127);
+	}
+
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) < 0)
+		return false;
+
+	if (usage.ru_maxrss > *peak_rss_kb)
+		*peak_rss_kb = usage.ru_maxrss;
+
+	if (WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) == 127)) {
+		fprintf(stderr, "perf_run: %s failed on %s\n", command[0], file);
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	int runs = 5;
+	vector<const char*> files;
+	int i = 1;
+
+	for (; i < argc && strcmp(argv[i], "--") != 0; i++) {
+		if (strncmp(argv[i], "--runs=", 7) == 0)
+			runs = atoi(argv[i] + 7);
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (runs < 1 || files.empty() || i + 1 >= argc) {
+		fprintf(stderr, "usage: perf_run [--runs=N] file... -- command [args...]\n");
+		return 1;
+	}
+
+	char** command = argv + i + 1;
+	vector<double> samples;
+	long peak_rss_kb = 0;
+
+	for (int r = 0; r < runs; r++) {
+		double start = now_ms();
+		for (auto file : files) {
+			if (!run_once(file, command, &peak_rss_kb))
+				return 2;
+		}
+		samples.push_back(now_ms() - start);
+	}
+
+	sort(samples.begin(), samples.end());
+	printf("runs=%d min_ms=%.3f median_ms=%.3f peak_rss_kb=%ld\n",
+			runs, samples[0], samples[samples.size() / 2], peak_rss_kb);
+
+	return 0;
+}
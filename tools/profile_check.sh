@@ -0,0 +1,68 @@
+#!/bin/bash
+#
+# Checks that --profile reports repeated nested calls as written, with a
+# collapsed stack per call chain and records for every polynomial, rather
+# than the compositions the optimizer would otherwise inline them into.
+# Run from the repository root.
+#
+# usage: tools/profile_check.sh
+
+work=./profile_work
+
+if [ ! -x "./a.out" ]; then
+    echo "Error: a.out not found!"
+    exit 1
+fi
+
+mkdir -p ${work}
+
+cat > ${work}/nested.txt <<EOF
+POLY F = 2 x + 3;
+POLY X(a, b) = a + b;
+START
+INPUT G;
+F(X(5, G));
+F(X(5, G));
+F(X(5, G));
+F(X(5, G));
+F(X(5, G));
+1
+EOF
+
+let failed=0
+
+./a.out < ${work}/nested.txt > ${work}/expected.txt
+./a.out --profile=${work}/stacks.txt < ${work}/nested.txt > ${work}/output.txt 2> ${work}/summary.txt
+
+if ! cmp -s ${work}/expected.txt ${work}/output.txt; then
+    echo "results differ with --profile"
+    failed=1
+fi
+
+# one F;X chain per statement, on lines 5 to 9
+for line in 5 6 7 8 9; do
+    if ! grep -q "^F:${line};X:${line} [0-9]*$" ${work}/stacks.txt; then
+        echo "no F:${line};X:${line} stack"
+        failed=1
+    fi
+done
+
+for poly in F X; do
+    if ! grep -q "^profile: polynomial=${poly} calls=5 " ${work}/summary.txt; then
+        echo "no record of 5 calls to ${poly}"
+        failed=1
+    fi
+done
+
+if grep -q "#" ${work}/stacks.txt ${work}/summary.txt; then
+    echo "an inlined composition was profiled"
+    failed=1
+fi
+
+rm -rf ${work}
+
+if [ ${failed} -ne 0 ]; then
+    echo "Profile check failed"
+    exit 1
+fi
+echo "Profile check passed"
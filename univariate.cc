@@ -0,0 +1,271 @@
+/*
+ * Evaluation of one-parameter polynomials at many points at once
+ */
+#include <algorithm>
+
+#include "parser.h"
+#include "univariate.h"
+
+using namespace std;
+
+bool dense_univariate(const polynomial* p, int max_degree, dense_poly& coefficients) {
+	if (p->param_names.size() != 1)
+		return false;
+
+	coefficients.assign(1, 0);
+	char sign = '+';
+
+	for (auto curr_term : p->polynomial_body) {
+		long exp = 0;
+		for (auto curr_mon : curr_term->m_list) {
+			if (curr_mon->var_name != 0)
+				return false;
+			exp += curr_mon->exp;
+		}
+		if (exp > max_degree)
+			return false;
+		if (exp >= coefficients.size())
+			coefficients.resize(exp + 1, 0);
+
+		unsigned int c = (unsigned int) curr_term->coefficient;
+		coefficients[exp] += (sign == '-') ? 0u - c : c;
+		sign = curr_term->op;
+	}
+
+	while (coefficients.size() > 1 && coefficients.back() == 0)
+		coefficients.pop_back();
+
+	return true;
+}
+
+unsigned int horner(const dense_poly& f, unsigned int x) {
+	unsigned int result = 0;
+
+	for (int e = f.size() - 1; e >= 0; e--)
+		result = result * x + f[e];
+
+	return result;
+}
+
+// f(start + i * step) is a polynomial of the same degree d in i, so its d-th
+// forward difference is constant and the table of differences at point i
+// advances to point i + 1 with d additions. Wrap-around arithmetic keeps
+// this exact, since reduction modulo 2^32 commutes with + and *.
+void forward_differences(const dense_poly& f, unsigned int start, unsigned int step,
+		vector<unsigned int>& out) {
+	int degree = f.size() - 1;
+	int count = out.size();
+	vector<unsigned int> diff(degree + 1);
+
+	for (int i = 0; i <= degree; i++)
+		diff[i] = horner(f, start + (unsigned int) i * step);
+
+	// diff[k] = k-th difference at point 0
+	for (int k = 1; k <= degree; k++) {
+		for (int i = degree; i >= k; i--)
+			diff[i] -= diff[i - 1];
+	}
+
+	for (int i = 0; i < count; i++) {
+		out[i] = diff[0];
+		for (int k = 0; k < degree; k++)
+			diff[k] += diff[k + 1];
+	}
+}
+
+//////////////////////////////////////////////////////
+// Multipoint evaluation
+//////////////////////////////////////////////////////
+
+// below this length products are computed by the schoolbook method
+#define KARATSUBA_CUTOFF 32
+// below this degree remainders are computed by long division
+#define NEWTON_CUTOFF 256
+// subproduct tree nodes with at most this many points are finished by Horner
+#define TREE_LEAF_POINTS 16
+
+static void trim(dense_poly& f) {
+	while (f.size() > 1 && f.back() == 0)
+		f.pop_back();
+}
+
+// out[0 .. 2n) = a * b, for a and b of length n; scratch must hold 8n values
+static void karatsuba(const unsigned int* a, const unsigned int* b, int n, unsigned int* out,
+		unsigned int* scratch) {
+	if (n <= KARATSUBA_CUTOFF) {
+		fill(out, out + 2 * n, 0);
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++)
+				out[i + j] += a[i] * b[j];
+		}
+		return;
+	}
+
+	// a = a0 + x^h a1 with a0 of length h and a1 of length k >= h
+	int h = n / 2;
+	int k = n - h;
+	unsigned int* sa = scratch;
+	unsigned int* sb = sa + k;
+	unsigned int* mid = sb + k;
+
+	for (int i = 0; i < k; i++) {
+		sa[i] = a[h + i] + (i < h ? a[i] : 0);
+		sb[i] = b[h + i] + (i < h ? b[i] : 0);
+	}
+
+	karatsuba(a, b, h, out, scratch + 4 * k);
+	karatsuba(a + h, b + h, k, out + 2 * h, scratch + 4 * k);
+	karatsuba(sa, sb, k, mid, scratch + 4 * k);
+
+	for (int i = 0; i < 2 * h; i++)
+		mid[i] -= out[i];
+	for (int i = 0; i < 2 * k; i++)
+		mid[i] -= out[2 * h + i];
+	for (int i = 0; i < 2 * k; i++)
+		out[h + i] += mid[i];
+}
+
+static dense_poly multiply(const dense_poly& a, const dense_poly& b) {
+	int n = max(a.size(), b.size());
+	dense_poly pa(a), pb(b), product(2 * n);
+	vector<unsigned int> scratch(8 * n);
+
+	pa.resize(n, 0);
+	pb.resize(n, 0);
+	karatsuba(pa.data(), pb.data(), n, product.data(), scratch.data());
+	product.resize(a.size() + b.size() - 1);
+
+	return product;
+}
+
+// inverse of f modulo x^n, for f with constant coefficient 1, by Newton
+// iteration: if h = 1/f mod x^k then h (2 - f h) = 1/f mod x^2k
+static dense_poly inverse(const dense_poly& f, int n) {
+	dense_poly h(1, 1);
+
+	for (int k = 1; k < n; ) {
+		k = min(2 * k, n);
+		dense_poly fk(f.begin(), f.begin() + min((int) f.size(), k));
+		dense_poly e = multiply(fk, h);
+		e.resize(k, 0);
+		for (auto& c : e)
+			c = 0u - c;
+		e[0] += 2;
+		h = multiply(h, e);
+		h.resize(k, 0);
+	}
+
+	return h;
+}
+
+// f mod g for a monic g; inv is the inverse of g with its coefficients
+// reversed modulo x^(deg f - deg g + 1), or empty for long division
+static dense_poly remainder(const dense_poly& f, const dense_poly& g, const dense_poly& inv) {
+	int n = f.size() - 1;
+	int m = g.size() - 1;
+
+	if (n < m)
+		return f;
+
+	if (inv.empty()) {
+		dense_poly r(f);
+		for (int i = n; i >= m; i--) {
+			unsigned int q = r[i];
+			if (q == 0)
+				continue;
+			for (int j = 0; j <= m; j++)
+				r[i - m + j] -= q * g[j];
+		}
+		r.resize(max(m, 1));
+		trim(r);
+		return r;
+	}
+
+	// the quotient reversed is rev(f) / rev(g) modulo x^(n - m + 1)
+	int k = n - m + 1;
+	dense_poly rf(f.rbegin(), f.rbegin() + k);
+	dense_poly q = multiply(rf, inv);
+	q.resize(k);
+	reverse(q.begin(), q.end());
+
+	dense_poly qg = multiply(q, g);
+	dense_poly r(max(m, 1), 0);
+	for (int i = 0; i < m; i++)
+		r[i] = f[i] - qg[i];
+	trim(r);
+	return r;
+}
+
+static dense_poly remainder(const dense_poly& f, const dense_poly& g) {
+	int n = f.size() - 1;
+	int m = g.size() - 1;
+
+	if (n < m || m < NEWTON_CUTOFF || n - m < NEWTON_CUTOFF)
+		return remainder(f, g, dense_poly());
+
+	dense_poly rg(g.rbegin(), g.rend());
+	return remainder(f, g, inverse(rg, n - m + 1));
+}
+
+// node i of a subproduct tree over points [begin, end) holds the product of
+// (x - point) over its points; children of node i are 2i + 1 and 2i + 2
+static void build_tree(const unsigned int* points, int begin, int end, int i,
+		vector<dense_poly>& tree) {
+	if (end - begin <= TREE_LEAF_POINTS) {
+		dense_poly product(1, 1);
+		for (int j = begin; j < end; j++) {
+			// multiply by (x - points[j])
+			product.push_back(0);
+			for (int e = product.size() - 1; e > 0; e--)
+				product[e] = product[e - 1] - points[j] * product[e];
+			product[0] = 0u - points[j] * product[0];
+		}
+		tree[i] = product;
+		return;
+	}
+
+	int mid = begin + (end - begin) / 2;
+	build_tree(points, begin, mid, 2 * i + 1, tree);
+	build_tree(points, mid, end, 2 * i + 2, tree);
+	tree[i] = multiply(tree[2 * i + 1], tree[2 * i + 2]);
+}
+
+// f is already reduced modulo node i; reduces it down to the leaves
+static void descend(const dense_poly& f, const unsigned int* points, int begin, int end, int i,
+		const vector<dense_poly>& tree, unsigned int* out) {
+	if (end - begin <= TREE_LEAF_POINTS) {
+		for (int j = begin; j < end; j++)
+			out[j] = horner(f, points[j]);
+		return;
+	}
+
+	int mid = begin + (end - begin) / 2;
+	descend(remainder(f, tree[2 * i + 1]), points, begin, mid, 2 * i + 1, tree, out);
+	descend(remainder(f, tree[2 * i + 2]), points, mid, end, 2 * i + 2, tree, out);
+}
+
+// Reduces f modulo the product of (x - point) over a block of points with a
+// subproduct tree, then follows the tree down, reducing modulo each child,
+// until few enough points are left for Horner. With Karatsuba products and
+// Newton division a block of n points costs O(n^1.59 log n) instead of the
+// O(n deg f) of evaluating every point on its own. Blocks are about as large
+// as the degree of f, where the saving is largest.
+void multipoint(const dense_poly& f, const vector<unsigned int>& points, vector<unsigned int>& out) {
+	int degree = f.size() - 1;
+	int block = max(degree, 2 * TREE_LEAF_POINTS);
+
+	out.resize(points.size());
+
+	for (int begin = 0; begin < points.size(); begin += block) {
+		int n = min(block, (int) points.size() - begin);
+		const unsigned int* p = points.data() + begin;
+
+		int nodes = 1;
+		while (nodes < 2 * ((n + TREE_LEAF_POINTS - 1) / TREE_LEAF_POINTS))
+			nodes *= 2;
+		vector<dense_poly> tree(2 * nodes);
+
+		build_tree(p, 0, n, 0, tree);
+		descend(remainder(f, tree[0]), p, 0, n, 0, tree, out.data() + begin);
+	}
+}
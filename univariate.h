@@ -0,0 +1,32 @@
+/*
+ * Evaluation of one-parameter polynomials at many points at once
+ */
+#ifndef __UNIVARIATE_H__
+#define __UNIVARIATE_H__
+
+#include <vector>
+
+struct polynomial;
+
+// A one-parameter polynomial in dense form: coefficient e is the coefficient
+// of x^e. All arithmetic is modulo 2^32, like evaluate_polynomial()'s.
+typedef std::vector<unsigned int> dense_poly;
+
+// sets coefficients to the dense form of p; returns false if p has more than
+// one parameter or a degree above max_degree
+bool dense_univariate(const polynomial* p, int max_degree, dense_poly& coefficients);
+
+unsigned int horner(const dense_poly& f, unsigned int x);
+
+// out[i] = f(start + i * step) for 0 <= i < out.size(), by finite forward
+// differences: after evaluating the first degree + 1 points, every further
+// point costs degree additions
+void forward_differences(const dense_poly& f, unsigned int start, unsigned int step,
+		std::vector<unsigned int>& out);
+
+// out[i] = f(points[i]) for every point, by reducing f modulo subproduct
+// trees of the points; cheaper than Horner's rule for high degrees
+void multipoint(const dense_poly& f, const std::vector<unsigned int>& points,
+		std::vector<unsigned int>& out);
+
+#endif